@@ -5,7 +5,7 @@
 #include <cctype>
 #include <map>
 #include <bitset>
-#include "dfa.h"
+#include "mips.h"
 
 using namespace std;
 
@@ -39,7 +39,7 @@ void translate(vector<token> &program);
     int main() {
       DFA dfa;
       try {
-        stringstream s (DFAstring);
+        stringstream s (MIPS_DFA);
         dfa.DFAbuild(s);
       } catch(runtime_error &e) {
         cerr << "ERROR: " << e.what() << "\n";
@@ -75,55 +75,10 @@ long regToInt (string reg) {
 }
 
 void translate(vector<token> &program) {
-    map<string, int> instr;
-    instr["add"] = 0;
-    instr["sub"] = 0;
-    instr["slt"] = 0;
-    instr["sltu"] = 0;
-
-    instr["mult"] = 1;
-    instr["multu"] = 1;
-    instr["div"] = 1;
-    instr["divu"] = 1;
-
-    instr["mfhi"] = 2;
-    instr["mflo"] = 2;
-    instr["lis"] = 2;
-    instr["jr"] = 2;
-    instr["jalr"] = 2;
-
-    instr["bne"] = 3;
-    instr["beq"] = 3;
-
-    instr["lw"] = 4;
-    instr["sw"] = 4;
-
-    map<string, int> opcode;
-    opcode["beq"] = 4;
-    opcode["bne"] = 5;
-    opcode["lw"] = 35;
-    opcode["sw"] = 43;
-
-    map<string, int>func_code;
-    func_code["add"] = 32;
-    func_code["sub"] = 34;
-    func_code["slt"] = 42;
-    func_code["sltu"] = 43;
-
-    func_code["mult"] = 24;
-    func_code["multu"] = 25;
-    func_code["div"] = 26;
-    func_code["divu"] = 27;
-
-    func_code["mfhi"] = 16;
-    func_code["mflo"] = 18;
-    func_code["lis"] = 20;
-    func_code["jr"] = 8;
-    func_code["jalr"] = 9;
-
      //add sub mult multu div divu mfhi mflo lis slt sltu jr jalr beq bne lw sw
     int pc = 0;
     map <string, long> labels; // (label, address)
+    map <string, bool> imports; // symbols the linker fills in
 
     // checks new labels and duplicates 
     // check proper format ignoring whether label values are valid
@@ -152,8 +107,19 @@ void translate(vector<token> &program) {
             }
         }
 
-        if (type == "ID" || type == "DOTID") {
-            if (instr.find(lexeme) == instr.end()) {
+        if (type == "DOTID" && lexeme == ".import") { // takes no space
+            if (i < length - 1 && program[i + 1].type == "ID") {
+                ++i;
+                imports[program[i].lexeme] = true;
+                if (i < length - 1) {
+                    ++i;
+                    if (program[i].type != "NEWLINE") throw runtime_error("ERROR: missing NEWLINE");
+                }
+            } else {
+                throw runtime_error("ERROR: No .import symbol defined");
+            }
+        } else if (type == "ID" || type == "DOTID") {
+            if (!findMipsOp(lexeme)) {
               if (type == "DOTID" && lexeme == ".word") {
                 if (i < length - 1) { // check appropriate length
                     ++i ;
@@ -168,8 +134,8 @@ void translate(vector<token> &program) {
                 throw runtime_error("ERROR: Invalid instruction ID/DOTID");
               }  
             } else {
-                switch (instr[lexeme]) {
-                    case 0 : // ID REGISTER COMMA REGISTER COMMA REGISTER
+                switch (findMipsOp(lexeme)->format) {
+                    case THREE_REG : // ID REGISTER COMMA REGISTER COMMA REGISTER
                         if (i < length - 5) {
                             if (program[i+1].type != "REGISTER") throw runtime_error("ERROR: invalid case 0 instruction: missing $d");
                             if (program[i+2].type != "COMMA") throw runtime_error("ERROR: invalid case 0 instruction: missing comma after $d");
@@ -181,7 +147,7 @@ void translate(vector<token> &program) {
                             throw runtime_error("ERROR: incomplete case 0 instruction");
                         }
                         break;
-                    case 1 : // ID REGISTER COMMA REGISTER
+                    case TWO_REG : // ID REGISTER COMMA REGISTER
                         if (i < length - 3) {
                             if (program[i+1].type != "REGISTER") throw runtime_error("ERROR: invalid case 1 instruction: missing $s");
                             if (program[i+2].type != "COMMA") throw runtime_error("ERROR: invalid case 1 instruction: missing comma after $s");
@@ -191,7 +157,7 @@ void translate(vector<token> &program) {
                             throw runtime_error("ERROR: incomplete case 1 instruction");
                         }
                         break;
-                    case 2 : // ID REGISTER
+                    case ONE_REG : // ID REGISTER
                         if (i < length - 1) {
                             if (program[i+1].type != "REGISTER") throw runtime_error("ERROR: invalid case 2 instruction: missing $d/$s");
                             i += 1;
@@ -199,7 +165,7 @@ void translate(vector<token> &program) {
                             throw runtime_error("ERROR: incomplete case 2 instruction");
                         }
                         break;
-                    case 3 : // ID REGISTER COMMA REGISTER COMMA [DECINT || HEXINT || ID]
+                    case BRANCH : // ID REGISTER COMMA REGISTER COMMA [DECINT || HEXINT || ID]
                         if (i < length - 5) {
                             if (program[i+1].type != "REGISTER") throw runtime_error("ERROR: invalid case 0 instruction: missing $s");
                             if (program[i+2].type != "COMMA") throw runtime_error("ERROR: invalid case 0 instruction: missing comma after $s");
@@ -211,7 +177,7 @@ void translate(vector<token> &program) {
                             throw runtime_error("ERROR: incomplete case 3 instruction");
                         }
                         break;
-                    case 4 : // ID REGISTER COMMA [DECINT or HEXINT] LPAREN REGISTER RPAREN
+                    case MEMORY : // ID REGISTER COMMA [DECINT or HEXINT] LPAREN REGISTER RPAREN
                         if (i < length - 6) {
                             if (program[i+1].type != "REGISTER") throw runtime_error("ERROR: invalid case 0 instruction: missing $t");
                             if (program[i+2].type != "COMMA") throw runtime_error("ERROR: invalid case 0 instruction: missing comma after $t");
@@ -255,8 +221,13 @@ void translate(vector<token> &program) {
         binary = 0;
         // space for one word (label, comment)
 
+        if (type == "DOTID" && lexeme == ".import") {
+            ++i;
+            continue;
+        }
         if (type == "ID" || type == "DOTID") {
-            if (instr.find(lexeme) == instr.end()) { // already checked so must be .word
+            const MipsOp * op = findMipsOp(lexeme);
+            if (!op) { // already checked so must be .word
                 ++i;
                 type = program[i].type ;
                 lexeme = program[i].lexeme ;
@@ -264,6 +235,8 @@ void translate(vector<token> &program) {
                   // check valid label
                   if (labels.find(lexeme) != labels.end()) {
                     binary = labels[lexeme] ;
+                  } else if (imports.find(lexeme) != imports.end()) {
+                    binary = 0 ; // left for the linker
                   } else {
                     throw runtime_error("ERROR: Label \""+ lexeme + "\" not found");
                   }
@@ -277,56 +250,24 @@ void translate(vector<token> &program) {
                 }
                 // cout << "binary: " << bitset<32>(binary) << "\n";
             } else {
-                switch (instr[lexeme]) {
-                    case 0 : // ID REGISTER COMMA REGISTER COMMA REGISTER
-                        binary += regToInt(program[i + 3].lexeme) ; // $s
-                        binary <<= 5 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
-                        binary += regToInt(program[i + 5].lexeme) ; // $t
-                        binary <<= 5 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
-                        binary += regToInt(program[i + 1].lexeme) ; // $d
-                        binary <<= 11 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
-                        binary +=  func_code[lexeme];
+                switch (op->format) {
+                    case THREE_REG : // ID REGISTER COMMA REGISTER COMMA REGISTER
+                        binary = encodeMips(*op, regToInt(program[i + 1].lexeme), regToInt(program[i + 3].lexeme), regToInt(program[i + 5].lexeme), 0);
                         i += 5;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
                         break;
-                    case 1 : // ID REGISTER COMMA REGISTER
-                        binary += regToInt(program[i + 1].lexeme) ; // $s
-                        binary <<= 5 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
-                        binary += regToInt(program[i + 3].lexeme) ; // $t
-                        binary <<= 16 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
-                        binary += func_code[lexeme];
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
+                    case TWO_REG : // ID REGISTER COMMA REGISTER
+                        binary = encodeMips(*op, 0, regToInt(program[i + 1].lexeme), regToInt(program[i + 3].lexeme), 0);
                         i += 3;
                         break;
-                    case 2 : // ID REGISTER
+                    case ONE_REG : // ID REGISTER
                         if (lexeme == "jr" || lexeme == "jalr") {
-                          binary += regToInt(program[i+1].lexeme) ;
-                          binary <<= 21 ;
-                          // cout << "binary: " << bitset<32>(binary) << "\n";
+                          binary = encodeMips(*op, 0, regToInt(program[i+1].lexeme), 0, 0);
                         } else { // mflo, mfhi, lis
-                          binary += regToInt(program[i+1].lexeme) ;
-                          binary <<= 11 ;
-                          // cout << "binary: " << bitset<32>(binary) << "\n";
+                          binary = encodeMips(*op, regToInt(program[i+1].lexeme), 0, 0, 0);
                         }
-                        binary += func_code[lexeme];
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
                         i += 1;
                         break;
-                    case 3 : // ID REGISTER COMMA REGISTER COMMA [DECINT || HEXINT || ID]
-                        binary += opcode[lexeme] ;
-                        binary <<= 5 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
-                        binary += regToInt(program[i + 1].lexeme) ; // $s
-                        binary <<= 5 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
-                        binary += regToInt(program[i + 3].lexeme) ; // $t
-                        binary <<= 16 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
+                    case BRANCH : // ID REGISTER COMMA REGISTER COMMA [DECINT || HEXINT || ID]
                         lexeme = program[i + 5].lexeme ; // i
                         type = program[i + 5].type ;
                         if (type == "ID") {
@@ -334,9 +275,6 @@ void translate(vector<token> &program) {
                           if (labels.find(lexeme) != labels.end()) {
                             immediate = (labels[lexeme] - pc - 4)/4 ;
                             if (immediate < -32768 || immediate > 32767) throw runtime_error("ERROR: immediate not in range") ;
-                            if (immediate < 0) {
-                              immediate = immediate & 0xFFFF ;
-                            }
                           } else {
                             throw runtime_error("ERROR: Label "+ lexeme + " not found");
                           }
@@ -347,38 +285,20 @@ void translate(vector<token> &program) {
                           } else { // DECINT
                             immediate = stoll(lexeme);
                             if (immediate < -32768 || immediate > 32767) throw runtime_error("ERROR: immediate not in range") ;
-                            if (immediate < 0) {
-                              immediate = immediate & 0xFFFF ;
-                            }
                           } 
                         }
-                        
-                        binary  += immediate ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
+                        binary = encodeMips(*op, 0, regToInt(program[i + 1].lexeme), regToInt(program[i + 3].lexeme), immediate);
                         i += 5;
                         break ;
-                    case 4 : // ID REGISTER COMMA [DECINT or HEXINT] LPAREN REGISTER RPAREN
-                        binary += opcode[lexeme] ;
-                        binary <<= 5 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
-                        binary += regToInt(program[i + 5].lexeme) ; // $s
-                        binary <<= 5 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
-                        binary += regToInt(program[i + 1].lexeme) ; // $t
-                        binary <<= 16 ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
+                    case MEMORY : // ID REGISTER COMMA [DECINT or HEXINT] LPAREN REGISTER RPAREN
                         if (program[i+3].type == "HEXINT") {
                           immediate = stoll(program[i + 3].lexeme, 0, 16) ; 
                           if (immediate > 65535) throw runtime_error("ERROR: immediate not in range") ;
                         } else { // DECINT
                           immediate = stoll(program[i + 3].lexeme);
                           if (immediate < -32768 || immediate > 32767) throw runtime_error("ERROR: immediate not in range") ;
-                          if (immediate < 0) {
-                            immediate = immediate & 0xFFFF ;
-                          }
                         } 
-                        binary  += immediate ;
-                        // cout << "binary: " << bitset<32>(binary) << "\n";
+                        binary = encodeMips(*op, 0, regToInt(program[i + 5].lexeme), regToInt(program[i + 1].lexeme), immediate);
                         i += 6;
                         break;
                 }
@@ -0,0 +1,184 @@
+#include "callgraph.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int CallGraph::add(const string & name) {
+  int p = names.size();
+  index[name] = p;
+  names.push_back(name);
+  callees.push_back(vector<int>());
+  callSites.push_back(0);
+  loopCallSites.push_back(0);
+  callsRuntime.push_back(false);
+  seen.push_back(-1);
+  return p;
+}
+
+void CallGraph::call(int caller, const string & name, bool inLoop) {
+  auto it = index.find(name);
+  if (it == index.end()) return;
+  int callee = it->second;
+  ++callSites[callee];
+  if (inLoop) ++loopCallSites[callee];
+  if (seen[callee] != caller) {
+    seen[callee] = caller;
+    callees[caller].push_back(callee);
+  }
+}
+
+void CallGraph::finish() {
+  int n = names.size();
+  auto start = chrono::steady_clock::now();
+  findSCCs();
+  sccTime = secondsSince(start);
+
+  start = chrono::steady_clock::now();
+  reachable.assign(n, false);
+  leaf.assign(n, false);
+  auto main = index.find("main");
+  vector<int> work;
+  if (main != index.end()) {
+    work.push_back(main->second);
+    reachable[main->second] = true;
+  }
+  while (!work.empty()) {
+    int p = work.back();
+    work.pop_back();
+    for (int c : callees[p]) {
+      if (!reachable[c]) {
+        reachable[c] = true;
+        work.push_back(c);
+      }
+    }
+  }
+  for (int p = 0; p < n; ++p) {
+    leaf[p] = callees[p].empty();
+  }
+  reachTime = secondsSince(start);
+}
+
+// Tarjan's algorithm with an explicit stack so deep call chains cannot
+// overflow the native one
+void CallGraph::findSCCs() {
+  int n = names.size();
+  vector<int> order(n, -1), low(n, 0);
+  vector<bool> onStack(n, false);
+  vector<int> stack;
+  vector<pair<int, int>> frames; // (procedure, next callee to visit)
+  scc.assign(n, -1);
+  recursive.assign(n, false);
+  sccs = 0;
+  int counter = 0;
+  for (int root = 0; root < n; ++root) {
+    if (order[root] != -1) continue;
+    frames.push_back({root, 0});
+    while (!frames.empty()) {
+      int p = frames.back().first;
+      int &next = frames.back().second;
+      if (next == 0 && order[p] == -1) {
+        order[p] = low[p] = counter++;
+        stack.push_back(p);
+        onStack[p] = true;
+      }
+      if (next < (int) callees[p].size()) {
+        int c = callees[p][next++];
+        if (c == p) recursive[p] = true;
+        if (order[c] == -1) {
+          frames.push_back({c, 0});
+        } else if (onStack[c]) {
+          low[p] = min(low[p], order[c]);
+        }
+        continue;
+      }
+      if (low[p] == order[p]) {
+        size_t top = stack.size();
+        while (stack[top - 1] != p) --top;
+        --top;
+        for (size_t i = top; i < stack.size(); ++i) {
+          int q = stack[i];
+          onStack[q] = false;
+          scc[q] = sccs;
+          if (stack.size() - top > 1) recursive[q] = true;
+        }
+        stack.resize(top);
+        ++sccs;
+      }
+      frames.pop_back();
+      if (!frames.empty()) {
+        int parent = frames.back().first;
+        low[parent] = min(low[parent], low[p]);
+      }
+    }
+  }
+}
+
+bool CallGraph::isRecursive(const string & name) const {
+  auto it = index.find(name);
+  return it != index.end() && recursive[it->second];
+}
+bool CallGraph::isReachable(const string & name) const {
+  auto it = index.find(name);
+  return it != index.end() && reachable[it->second];
+}
+bool CallGraph::isLeaf(const string & name) const {
+  auto it = index.find(name);
+  return it != index.end() && leaf[it->second];
+}
+
+void CallGraph::dumpDot(ostream & out) const {
+  out << "digraph callgraph {\n";
+  for (int p = 0; p < (int) names.size(); ++p) {
+    out << "  \"" << names[p] << "\" [label=\"" << names[p] << "\\ncalls: " << callSites[p] << "\"";
+    if (leaf[p]) out << ", shape=box";
+    if (recursive[p]) out << ", color=red";
+    if (!reachable[p]) out << ", style=dashed, fontcolor=gray";
+    out << "];\n";
+  }
+  for (int p = 0; p < (int) names.size(); ++p) {
+    for (int c : callees[p]) {
+      out << "  \"" << names[p] << "\" -> \"" << names[c] << "\";\n";
+    }
+  }
+  out << "}\n";
+}
+
+void CallGraph::dumpJSON(ostream & out) const {
+  int n = names.size();
+  out << "{\n  \"procedures\": [\n";
+  for (int p = 0; p < n; ++p) {
+    out << "    {\"name\": \"" << names[p] << "\", \"callees\": [";
+    for (int i = 0; i < (int) callees[p].size(); ++i) {
+      out << (i ? ", " : "") << "\"" << names[callees[p][i]] << "\"";
+    }
+    out << "], \"scc\": " << scc[p]
+        << ", \"recursive\": " << (recursive[p] ? "true" : "false")
+        << ", \"reachable\": " << (reachable[p] ? "true" : "false")
+        << ", \"leaf\": " << (leaf[p] ? "true" : "false")
+        << ", \"callsRuntime\": " << (callsRuntime[p] ? "true" : "false")
+        << ", \"callSites\": " << callSites[p]
+        << ", \"loopCallSites\": " << loopCallSites[p] << "}"
+        << (p + 1 < n ? ",\n" : "\n");
+  }
+  out << "  ],\n  \"sccs\": " << sccs << ",\n";
+  out << "  \"timing_ms\": {\"build\": " << buildTime * 1000 << ", \"scc\": " << sccTime * 1000
+      << ", \"reachability\": " << reachTime * 1000 << "}\n}\n";
+}
+
+void CallGraph::report(ostream & out) const {
+  int n = names.size(), live = 0, rec = 0, leaves = 0;
+  for (int p = 0; p < n; ++p) {
+    live += reachable[p];
+    rec += recursive[p];
+    leaves += leaf[p];
+  }
+  out << "call graph: " << n << " procedures, " << live << " reachable, " << n - live << " dead, "
+      << rec << " recursive, " << leaves << " leaf, " << sccs << " sccs\n";
+  out << "call graph time: build " << buildTime * 1000 << " ms, scc " << sccTime * 1000
+      << " ms, reachability " << reachTime * 1000 << " ms\n";
+}
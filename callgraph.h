@@ -0,0 +1,84 @@
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// whole-program call graph, for wlp4type and wlp4gen
+// procedures are numbered in definition order; wain is "main" and always last
+struct CallGraph {
+  std::vector<std::string> names;
+  std::map<std::string, int> index;
+  std::vector<std::vector<int>> callees; // distinct procedures called, in first-call order
+  std::vector<int> callSites;            // static calls to each procedure
+  std::vector<int> loopCallSites;        // of those, calls made inside a while body
+  std::vector<bool> callsRuntime;        // println, new or delete (these still use $31)
+  std::vector<int> scc;                  // component ids come out callees first
+  std::vector<bool> recursive;           // in a cycle, directly or through others
+  std::vector<bool> reachable;           // from wain
+  std::vector<bool> leaf;                // calls no procedures
+  int sccs = 0;
+  double buildTime = 0;                  // seconds
+  double sccTime = 0;
+  double reachTime = 0;
+
+  // builds the graph from the procedures node of either tool's parse tree,
+  // appending the procedure nodes to trees in the graph's order
+  template <class Tree> void build(Tree * procTree, std::vector<Tree*> * trees = nullptr);
+
+  // a procedure, in definition order; its number
+  int add(const std::string & name);
+  // a call from caller; one to a procedure never added is left out
+  void call(int caller, const std::string & callee, bool inLoop);
+  // SCCs, reachability and leaves, once every call is in
+  void finish();
+
+  // queries for codegen; unknown names (runtime routines) are never recursive
+  bool isRecursive(const std::string & name) const;
+  bool isReachable(const std::string & name) const;
+  bool isLeaf(const std::string & name) const;
+
+  void dumpDot(std::ostream & out) const;
+  void dumpJSON(std::ostream & out) const;
+  void report(std::ostream & out) const;
+
+private:
+  std::vector<int> seen; // last caller that recorded each callee
+  template <class Tree> void collectCalls(Tree * t, int caller, bool inLoop);
+  void findSCCs();
+};
+
+template <class Tree> void CallGraph::build(Tree * procTree, std::vector<Tree*> * trees) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Tree*> procs;
+  while (true) {
+    Tree * proc = (procTree->children.size() > 1) ? procTree->getChild("procedure",1) : procTree->getChild("main",1);
+    add((proc->LH == "main") ? "main" : proc->getChild("ID",1)->RH[0]);
+    procs.push_back(proc);
+    if (proc->LH == "main") break;
+    procTree = procTree->getChild("procedures",1);
+  }
+  for (int p = 0; p < (int) procs.size(); ++p) {
+    collectCalls(procs[p], p, false);
+  }
+  if (trees) trees->insert(trees->end(), procs.begin(), procs.end());
+  buildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  finish();
+}
+
+template <class Tree> void CallGraph::collectCalls(Tree * t, int caller, bool inLoop) {
+  if (t->LH == "factor" && t->RH.size() >= 3 && t->RH[0] == "ID") {
+    call(caller, t->getChild("ID",1)->RH[0], inLoop);
+  } else if (t->LH == "NEW" || t->LH == "PRINTLN" || t->LH == "DELETE") {
+    callsRuntime[caller] = true;
+  }
+  if (t->LH == "statement" && t->RH[0] == "WHILE") inLoop = true;
+  for (auto & c : t->children) {
+    collectCalls(c, caller, inLoop);
+  }
+}
+
+#endif
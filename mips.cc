@@ -0,0 +1,92 @@
+#include "mips.h"
+
+const MipsOp MIPS_OPS[] = {
+  {"add", THREE_REG, 0, 32},
+  {"sub", THREE_REG, 0, 34},
+  {"slt", THREE_REG, 0, 42},
+  {"sltu", THREE_REG, 0, 43},
+  {"mult", TWO_REG, 0, 24},
+  {"multu", TWO_REG, 0, 25},
+  {"div", TWO_REG, 0, 26},
+  {"divu", TWO_REG, 0, 27},
+  {"mfhi", ONE_REG, 0, 16},
+  {"mflo", ONE_REG, 0, 18},
+  {"lis", ONE_REG, 0, 20},
+  {"beq", BRANCH, 4, 0},
+  {"bne", BRANCH, 5, 0},
+  {"jr", ONE_REG, 0, 8},
+  {"jalr", ONE_REG, 0, 9},
+  {"lw", MEMORY, 35, 0},
+  {"sw", MEMORY, 43, 0},
+};
+const int MIPS_OP_COUNT = sizeof(MIPS_OPS) / sizeof(MIPS_OPS[0]);
+
+const MipsOp * findMipsOp(const std::string & name) {
+  for (int i = 0; i < MIPS_OP_COUNT; ++i) {
+    if (name == MIPS_OPS[i].name) return &MIPS_OPS[i];
+  }
+  return nullptr;
+}
+
+unsigned encodeMips(const MipsOp & op, int d, int s, int t, int imm) {
+  unsigned word = (unsigned) op.opcode << 26 | (unsigned) s << 21 | (unsigned) t << 16;
+  if (op.format == BRANCH || op.format == MEMORY) {
+    return word | (imm & 0xFFFF);
+  }
+  return word | (unsigned) d << 11 | op.func;
+}
+
+void appendWord(std::string & out, unsigned word) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out += (char) (word >> shift);
+  }
+}
+
+const std::string MIPS_DFA = R"(
+.STATES
+start
+dollar
+REGISTER!
+minus
+ZERO!
+DECINT!
+zerox
+HEXINT!
+ID!
+LABELDEF!
+dot
+DOTID!
+COMMA!
+LPAREN!
+RPAREN!
+NEWLINE!
+?WHITESPACE!
+?COMMENT!
+.TRANSITIONS
+start $ dollar
+dollar 0-9 REGISTER
+REGISTER 0-9 REGISTER
+start - minus
+minus 0-9 DECINT
+start 0 ZERO
+start 1-9 DECINT
+DECINT 0-9 DECINT
+ZERO 0-9 DECINT
+ZERO x zerox
+zerox 0-9 a-f A-F HEXINT
+HEXINT 0-9 a-f A-F HEXINT
+start a-z A-Z ID
+ID a-z A-Z 0-9 ID
+ID : LABELDEF
+start . dot
+dot a-z A-Z DOTID
+DOTID a-z A-Z DOTID
+start , COMMA
+start ( LPAREN
+start ) RPAREN
+start \n NEWLINE
+start \s \t \r ?WHITESPACE
+?WHITESPACE \s \t \r ?WHITESPACE
+start ; ?COMMENT
+?COMMENT \x00-\x09 \x0B-\x7F ?COMMENT
+)";
@@ -0,0 +1,36 @@
+#ifndef MIPS_H
+#define MIPS_H
+
+#include <string>
+
+// operand layouts, numbered as asm.cc's translate checks them
+enum MipsFormat {
+  THREE_REG = 0, // op $d, $s, $t
+  TWO_REG = 1,   // op $s, $t
+  ONE_REG = 2,   // op $d (mfhi, mflo, lis) or op $s (jr, jalr)
+  BRANCH = 3,    // op $s, $t, i
+  MEMORY = 4     // op $t, i($s)
+};
+
+struct MipsOp {
+  const char * name;
+  MipsFormat format;
+  int opcode; // bits 31..26, 0 for the register formats
+  int func;   // bits 5..0 of the register formats
+};
+
+// in the order add sub slt sltu mult multu div divu mfhi mflo lis beq bne jr jalr lw sw
+extern const MipsOp MIPS_OPS[];
+extern const int MIPS_OP_COUNT;
+
+// the instruction called name, or nullptr
+const MipsOp * findMipsOp(const std::string & name);
+// the word for op; imm is the 16-bit immediate of BRANCH and MEMORY, already range checked
+unsigned encodeMips(const MipsOp & op, int d, int s, int t, int imm);
+// appends word most significant byte first
+void appendWord(std::string & out, unsigned word);
+
+// the DFA asm and mipsscan tokenize assembly with, in DFAbuild's format
+extern const std::string MIPS_DFA;
+
+#endif
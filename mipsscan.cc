@@ -4,7 +4,7 @@
 #include <vector>
 #include <cctype>
 #include <map>
-#include "dfa.h"
+#include "mips.h"
 
 using namespace std;
 
@@ -323,7 +323,7 @@ struct DFA {
     int main() {
       DFA dfa;
       try {
-        stringstream s(DFAstring);
+        stringstream s(MIPS_DFA);
         dfa.DFAbuild(s);
       } catch(runtime_error &e) {
         cerr << "ERROR: " << e.what() << "\n";
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+# benchmarks for wlp4gen. Compiles each program in tests/bench, and a large
+# generated one, at each level and reports what the code does on the
+# emulator (tests/mips.py): instructions executed, cycles, branches (and taken),
+# loads and stores, procedure calls, the deepest stack and the static size,
+# with the time wlp4gen took. With --base another wlp4gen, say one built
+# from an older commit, is measured too and each count shown as base -> new.
+# Every run's output is checked against the reference interpreter, and
+# each of -O1, -O2 and -O3 must take no more steps or cycles than the level
+# below it on every program; the run fails otherwise.
+#
+# usage: tests/bench.py [--levels -O0,-O2] [--base WLP4GEN] [--gen WLP4GEN] [--procedures N]
+import argparse, os, subprocess, sys, time
+
+here = os.path.dirname(os.path.abspath(__file__))
+root = os.path.dirname(here)
+sys.path.insert(0, here)
+import fuzz, mips, run
+
+COUNTS = ['steps', 'cycles', 'branches', 'taken', 'loads', 'stores', 'calls', 'stack', 'static']
+LADDER = ['-O0', '-O1', '-O2', '-O3']
+
+def measure(gen, source, flags, want):
+    # the counts summed over the program's inputs, and the best of three compile times in ms
+    best = None
+    for _ in range(3):
+        start = time.perf_counter()
+        compiled = subprocess.run([gen] + flags.split(), input=source.encode(), capture_output=True)
+        took = time.perf_counter() - start
+        best = took if best is None else min(best, took)
+        if compiled.returncode:
+            sys.exit('%s %s: %s' % (gen, flags, compiled.stderr.decode().strip()))
+    total = dict.fromkeys(COUNTS, 0)
+    for (array, ints), w in zip(run.inputs(source), want):
+        out, result, counts = mips.run(compiled.stdout.decode(), ints, array)
+        if (out, result) != tuple(w):
+            sys.exit('%s %s on %s: want %s, got %s' % (gen, flags, ints, run.summary(w), run.summary((out, result))))
+        for k in COUNTS:
+            total[k] = max(total[k], counts[k]) if k in ('stack', 'static') else total[k] + counts[k]
+    total['ms'] = round(best * 1000, 1)
+    return total
+
+def cell(new, base):
+    if base is None:
+        return str(new)
+    change = '' if base == new or not base else ' (%+.0f%%)' % (100.0 * (new - base) / base)
+    return '%s -> %s%s' % (base, new, change)
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--levels', default='-O0,-O1,-O2,-O3,-O3 -fir,-Os', help='comma separated flag sets')
+    parser.add_argument('--base', help='a wlp4gen to compare against')
+    parser.add_argument('--gen', help='a wlp4gen to measure rather than the one built from the tree')
+    parser.add_argument('--procedures', type=int, default=2000, help='in the generated program')
+    args = parser.parse_args()
+    tools = run.build(os.environ.get('BUILD', os.path.join(root, '_test_build')))
+    os.environ['WLP4PARSE'] = tools['wlp4parse']
+    gen = args.gen or tools['wlp4gen']
+
+    programs = {}
+    directory = os.path.join(here, 'bench')
+    for f in sorted(os.listdir(directory)):
+        if f.endswith('.wlp4'):
+            programs[f[:-5]] = open(os.path.join(directory, f)).read()
+    programs['big%d' % args.procedures] = fuzz.big(args.procedures)
+
+    columns = COUNTS + ['ms']
+    slower = []
+    for name, source in programs.items():
+        want = run.expected(source)
+        print(name)
+        rows = [[''] + columns]
+        counts = {}
+        for flags in args.levels.split(','):
+            new = counts[flags] = measure(gen, source, flags, want)
+            base = measure(args.base, source, flags, want) if args.base else {}
+            rows.append([flags] + [cell(new[k], base.get(k)) for k in columns])
+        widths = [max(len(r[i]) for r in rows) for i in range(len(columns) + 1)]
+        for r in rows:
+            print('  ' + '  '.join(c.rjust(w) if i else c.ljust(w) for i, (c, w) in enumerate(zip(r, widths))))
+        ladder = [flags for flags in LADDER if flags in counts]
+        for low, high in zip(ladder, ladder[1:]):
+            for k in ('steps', 'cycles'):
+                if counts[high][k] > counts[low][k]:
+                    slower.append('%s: %s %s %d, %s %d' % (name, k, high, counts[high][k], low, counts[low][k]))
+    for s in slower:
+        print('SLOWER', s)
+    return 1 if slower else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
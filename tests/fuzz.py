@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+# writes a random WLP4 program for seed: procedures of one to six
+# parameters, some never read, some whose address is taken, calls to earlier
+# procedures, bounded loops and self tail recursion on a depth parameter.
+# Every program terminates and never divides by zero. big(n) is a large,
+# regular program of n procedures instead, for compile times.
+# usage: fuzz.py SEED | fuzz.py --big N
+import random, sys
+
+class Gen:
+    def __init__(self, seed):
+        self.r = random.Random(seed)
+        self.procs = [] # (name, number of parameters)
+
+    def number(self, n): # WLP4 has no negative literals
+        return str(n) if n >= 0 else '(0 - %d)' % -n
+
+    def expr(self, names, depth, calls):
+        r = self.r
+        k = r.randrange(10)
+        if depth <= 0 or k < 3:
+            return r.choice(names) if names and r.randrange(3) else self.number(r.randrange(-20, 100))
+        if k < 8:
+            op = r.choice('+-*+-*/%')
+            if op in '/%':
+                return '(%s %s %s)' % (self.expr(names, depth - 1, calls), op, self.number(r.choice([1, 2, 3, 4, 7, -5, 10])))
+            return '(%s %s %s)' % (self.expr(names, depth - 1, calls), op, self.expr(names, depth - 1, calls))
+        if calls and self.procs:
+            name, n = r.choice(self.procs)
+            args = [str(r.randrange(0, 2))] + [self.expr(names, depth - 2, False) for _ in range(n - 1)]
+            return '%s(%s)' % (name, ', '.join(args))
+        return self.expr(names, depth - 1, calls)
+
+    def test(self, names):
+        return '%s %s %s' % (self.expr(names, 2, False), self.r.choice(['<', '>', '<=', '>=', '==', '!=']),
+                             self.expr(names, 2, False))
+
+    def statements(self, names, targets, depth, loops, calls):
+        r = self.r
+        out = []
+        for _ in range(r.randrange(1, 4)):
+            k = r.randrange(10)
+            if k < 5 or depth <= 0:
+                out.append('%s = %s;' % (r.choice(targets), self.expr(names, 3, calls)))
+            elif k < 7:
+                out.append('if (%s) {' % self.test(names))
+                out += ['  ' + s for s in self.statements(names, targets, depth - 1, loops, calls)]
+                out.append('} else {')
+                out += ['  ' + s for s in self.statements(names, targets, depth - 1, loops, calls)]
+                out.append('}')
+            elif k < 9 and loops:
+                i = loops.pop()
+                out.append('%s = 0;' % i)
+                out.append('while (%s < %d) {' % (i, r.randrange(1, 6)))
+                # no calls in loops, or the calls multiply out of hand
+                out += ['  ' + s for s in self.statements(names, targets, depth - 1, loops, False)]
+                out.append('  %s = %s + 1;' % (i, i))
+                out.append('}')
+            else:
+                out.append('println(%s);' % self.expr(names, 2, False))
+        return out
+
+    def procedure(self, index):
+        r = self.r
+        name = 'f%d' % index
+        n = r.randrange(1, 7)
+        params = ['d'] + ['p%d' % k for k in range(1, n)]
+        unread = set(p for p in params[1:] if r.randrange(4) == 0)
+        read = [p for p in params if p not in unread]
+        locals_ = ['v%d' % k for k in range(r.randrange(0, 4))]
+        loops = ['i%d' % k for k in range(r.randrange(0, 3))]
+        out = ['int %s(%s) {' % (name, ', '.join('int ' + p for p in params))]
+        for v in locals_ + loops:
+            out.append('  int %s = %d;' % (v, r.randrange(0, 20)))
+        out.append('  int r = 0;')
+        if r.randrange(3) == 0:
+            out.append('  int *q = NULL;')
+        names = read + locals_
+        targets = locals_ + [p for p in read if p != 'd'] or ['r']
+        out += ['  ' + s for s in self.statements(names, targets, 2, list(loops), True)]
+        if '  int *q = NULL;' in out:
+            t = r.choice(targets)
+            out.append('  q = &%s;' % t)
+            out.append('  *q = *q + %s;' % self.expr(names, 2, False))
+        # the tail call passes a new value to every parameter, read or not
+        args = ['d - 1'] + [self.expr(names, 2, False) for _ in range(n - 1)]
+        if r.randrange(4):
+            args[1:] = r.sample(args[1:], n - 1) if r.randrange(2) else args[1:]
+        out.append('  if (d > 0) {')
+        out.append('    r = %s(%s);' % (name, ', '.join(args)))
+        out.append('  } else {')
+        out.append('    r = %s;' % self.expr(names, 3, True))
+        out.append('  }')
+        out.append('  return r;')
+        out.append('}')
+        self.procs.append((name, n))
+        return out
+
+    def program(self):
+        r = self.r
+        out = []
+        for i in range(r.randrange(2, 6)):
+            out += self.procedure(i)
+        out.append('int wain(int a, int b) {')
+        out.append('  int r = 0;')
+        for name, n in self.procs:
+            args = [str(r.randrange(0, 6))] + [self.expr(['a', 'b'], 2, False) for _ in range(n - 1)]
+            out.append('  r = r + %s(%s);' % (name, ', '.join(args)))
+            out.append('  println(r);')
+        out.append('  return r;')
+        out.append('}')
+        return '\n'.join(out) + '\n'
+
+def big(n, seed=1):
+    # n procedures, each with a loop, a branch and & of a local, calling one
+    # defined before it; wain calls the last
+    rand = random.Random(seed)
+    procs = []
+    for i in range(n):
+        call = 'f%d(a, c)' % rand.randrange(i) if i else '1'
+        procs.append('int f%d(int a, int b) {\n  int c = %d;\n  int* p = NULL;\n'
+                     '  while (a < b) {\n    c = c + a * 2 - b / 3;\n    a = a + 1;\n  }\n'
+                     '  if (c > 100) {\n    c = c %% 97;\n  } else {\n    c = c + 1;\n  }\n'
+                     '  p = &c;\n  *p = *p + %s;\n  return c;\n}\n' % (i, i, call))
+    procs.append('int wain(int a, int b) {\n  int r = 0;\n  r = f%d(a, b);\n  println(r);\n  return r;\n}\n' % (n - 1))
+    return '// args: 7 40\n' + ''.join(procs)
+
+def wide(n):
+    # wain with n locals, all read, so the frame outgrows lw and sw's offsets
+    names = ['v%d' % i for i in range(n)]
+    return ('// args: 1 2\nint wain(int a, int b) {\n' + ''.join('  int %s = %d;\n' % (v, i % 7) for i, v in enumerate(names)) +
+            ''.join('  a = a + %s;\n' % v for v in names) + '  return a;\n}\n')
+
+if __name__ == '__main__':
+    if sys.argv[1] == '--big':
+        sys.stdout.write(big(int(sys.argv[2])))
+    else:
+        sys.stdout.write(Gen(int(sys.argv[1])).program())
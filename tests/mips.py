@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+# runs wlp4gen's assembly as mips.twoints or mips.array would, supplying
+# print, new, delete and init, and counts what it executes: steps, branches
+# (and taken), loads, stores, mults, divs, procedure calls, the deepest
+# stack, cycles (steps, with 12 for a mult and 35 for a div) and the
+# static instruction count.
+# usage: mips.py [--array] program.asm ints...
+import re, sys
+
+def s32(x):
+    x &= 0xffffffff
+    return x - (1 << 32) if x & 0x80000000 else x
+
+def u32(x):
+    return x & 0xffffffff
+
+RUNTIME = {'print': 0x7f000000, 'new': 0x7f000010, 'delete': 0x7f000020, 'init': 0x7f000030}
+RETURN = 0x8123456c # $31 on entry: returning there ends the run
+STACK = 0x01000000
+LABEL = re.compile(r'^([A-Za-z_][A-Za-z0-9_]*):\s*(.*)$')
+NUMBER = re.compile(r'^-?\d+$')
+
+def assemble(text):
+    code, labels, imports = [], {}, set()
+    for line in text.split('\n'):
+        line = line.split(';')[0].strip()
+        while True:
+            m = LABEL.match(line)
+            if not m:
+                break
+            if m.group(1) in labels:
+                raise Exception('duplicate label ' + m.group(1))
+            labels[m.group(1)] = 4 * len(code)
+            line = m.group(2)
+        if not line:
+            continue
+        if line.startswith('.import'):
+            imports.add(line.split()[1])
+            continue
+        code.append(line.replace(',', ' ').replace('(', ' ').replace(')', ' ').split())
+    for name in imports:
+        labels[name] = RUNTIME[name]
+    return code, labels
+
+def run(text, ints, array=False, limit=200000000):
+    code, labels = assemble(text)
+    def value(t):
+        if NUMBER.match(t):
+            return int(t)
+        return int(t, 16) if t.startswith('0x') else labels[t]
+    R, mem, hi, lo = [0] * 32, {}, 0, 0
+    R[30], R[31] = STACK, RETURN
+    heap, out = [0x00800000], []
+    if array:
+        base = 0x00400000
+        for i, v in enumerate(ints):
+            mem[base + 4 * i] = u32(v)
+        R[1], R[2] = base, len(ints)
+    else:
+        R[1], R[2] = u32(ints[0]), u32(ints[1])
+    n = {k: 0 for k in ('steps', 'branches', 'taken', 'loads', 'stores', 'mults', 'divs', 'calls')}
+    deepest = STACK
+    pc = 0
+    runtime = set(RUNTIME.values())
+    while pc != RETURN:
+        if pc in runtime:
+            if pc == RUNTIME['print']:
+                out.append(str(s32(R[1])))
+            elif pc == RUNTIME['new']:
+                size = s32(R[1])
+                R[3] = 0 if size <= 0 else heap[0]
+                heap[0] += 4 * max(size, 0)
+            pc = R[31]
+            continue
+        if pc % 4 or pc // 4 >= len(code):
+            raise Exception('bad pc %x' % pc)
+        ins = code[pc // 4]
+        op = ins[0]
+        pc += 4
+        n['steps'] += 1
+        if n['steps'] > limit:
+            raise Exception('too many steps')
+        reg = lambda i: int(ins[i][1:])
+        if op in ('add', 'sub', 'slt', 'sltu'):
+            d, s, t = reg(1), reg(2), reg(3)
+            if op == 'add':
+                v = R[s] + R[t]
+            elif op == 'sub':
+                v = R[s] - R[t]
+            elif op == 'slt':
+                v = int(s32(R[s]) < s32(R[t]))
+            else:
+                v = int(R[s] < R[t])
+            if d:
+                R[d] = u32(v)
+        elif op in ('mult', 'multu'):
+            s, t = reg(1), reg(2)
+            n['mults'] += 1
+            p = s32(R[s]) * s32(R[t]) if op == 'mult' else R[s] * R[t]
+            lo, hi = u32(p), u32(p >> 32)
+        elif op in ('div', 'divu'):
+            s, t = reg(1), reg(2)
+            n['divs'] += 1
+            x, y = (s32(R[s]), s32(R[t])) if op == 'div' else (R[s], R[t])
+            if y == 0:
+                raise Exception('division by zero')
+            q = abs(x) // abs(y)
+            q = q if (x < 0) == (y < 0) else -q
+            lo, hi = u32(q), u32(x - q * y)
+        elif op in ('mfhi', 'mflo'):
+            if reg(1):
+                R[reg(1)] = hi if op == 'mfhi' else lo
+        elif op == 'lis':
+            word = code[pc // 4]
+            if word[0] != '.word':
+                raise Exception('lis without .word at %x' % (pc - 4))
+            if reg(1):
+                R[reg(1)] = u32(value(word[1]))
+            pc += 4
+        elif op in ('lw', 'sw'):
+            t, at = reg(1), u32(R[int(ins[3][1:])] + int(ins[2], 0))
+            if at % 4:
+                raise Exception('unaligned address %x' % at)
+            if op == 'lw':
+                n['loads'] += 1
+                if t:
+                    R[t] = mem.get(at, 0)
+            else:
+                n['stores'] += 1
+                mem[at] = R[t]
+        elif op in ('beq', 'bne'):
+            s, t, to = reg(1), reg(2), ins[3]
+            n['branches'] += 1
+            if (R[s] == R[t]) == (op == 'beq'):
+                pc += 4 * (int(to) if NUMBER.match(to) else (value(to) - pc) // 4)
+                n['taken'] += 1
+        elif op == 'jr':
+            pc = R[reg(1)]
+        elif op == 'jalr':
+            to = R[reg(1)]
+            R[31], pc = pc, to
+            if to not in runtime:
+                n['calls'] += 1
+        else:
+            raise Exception('cannot execute %s at %x' % (op, pc - 4))
+        deepest = min(deepest, R[30])
+    n['stack'] = STACK - deepest
+    n['cycles'] = n['steps'] + 11 * n['mults'] + 34 * n['divs']
+    n['static'] = len(code)
+    return out, s32(R[3]), n
+
+if __name__ == '__main__':
+    argv = sys.argv[1:]
+    array = argv[:1] == ['--array']
+    if array:
+        argv = argv[1:]
+    out, result, counts = run(open(argv[0]).read(), [int(x) for x in argv[1:]], array)
+    for line in out:
+        print(line)
+    print('ret', result, file=sys.stderr)
+    print(' '.join('%s=%d' % kv for kv in counts.items()), file=sys.stderr)
@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+# differential tests for wlp4gen. Builds the tools, then compiles every
+# program in tests/programs at each level, and with each optimization turned
+# off in turn at a level that has it, and checks the MIPS prints and returns
+# what the reference interpreter (wlp4.py) says. Random programs from
+# fuzz.py, and a large regular one, are checked at each level. At each level, too, what --binary
+# writes must be what asm makes of the assembly.
+#
+# Each program in tests/errors must fail to compile, with wlp4type, wlp4gen
+# and wlp4gen --fused all reporting exactly the errors in its .err file.
+#
+# wlp4type --cache-dir must say what wlp4type alone says about every one of
+# these, cold and warm, and recheck just the procedure an edit touched.
+#
+# A program runs wain with the ints of each "// args:" line, or an array of
+# those of each "// array:" line; with neither, with 7 and 4.
+#
+# usage: tests/run.py [--seeds N] [--jobs N] [--gen WLP4GEN]
+import argparse, concurrent.futures, os, re, subprocess, sys, tempfile
+
+here = os.path.dirname(os.path.abspath(__file__))
+root = os.path.dirname(here)
+sys.path.insert(0, here)
+import fuzz, mips, wlp4
+
+LEVELS = ['-O0', '-O1', '-O2', '-O3', '-O3 -fir', '-Os', '-O1 --fused', '-O3 --fused', '-O3 -fir --verify-ir']
+
+def build(out):
+    os.makedirs(out, exist_ok=True)
+    cxx = os.environ.get('CXX', 'g++')
+    tools = {
+        'wlp4gen': ['wlp4gen.cc', 'dfa.cc', 'wlp4data.cc', 'mips.cc', 'callgraph.cc'],
+        'wlp4parse': ['wlp4parse.cc', 'dfa.cc', 'wlp4data.cc'],
+        'wlp4type': ['wlp4type.cc', 'dfa.cc', 'wlp4data.cc', 'callgraph.cc'],
+        'asm': ['asm.cc', 'mips.cc'],
+    }
+    for tool, sources in tools.items():
+        made = subprocess.run([cxx, '-std=c++17', '-O2', '-o', os.path.join(out, tool)] +
+                              [os.path.join(root, s) for s in sources], capture_output=True)
+        if made.returncode:
+            sys.exit(made.stderr.decode())
+    return {tool: os.path.join(out, tool) for tool in tools}
+
+def inputs(source):
+    runs = []
+    for kind, ints in re.findall(r'^// (args|array):(.*)$', source, re.M):
+        runs.append((kind == 'array', [int(x) for x in ints.split()]))
+    return runs or [(False, [7, 4])]
+
+def expected(source):
+    results = []
+    for array, ints in inputs(source):
+        try:
+            results.append(wlp4.run(source, ints, array))
+        except Exception as e:
+            results.append(('error', str(e)))
+    return results
+
+def check(gen, name, source, flags, want):
+    # the failures of one program compiled with flags, as messages
+    compiled = subprocess.run([gen] + flags.split(), input=source.encode(), capture_output=True)
+    if compiled.returncode:
+        return ['%s %s: wlp4gen failed: %s' % (name, flags, compiled.stderr.decode().strip())]
+    failures = []
+    for (array, ints), w in zip(inputs(source), want):
+        try:
+            out, result, _ = mips.run(compiled.stdout.decode(), ints, array, limit=50000000)
+            got = (out, result)
+        except Exception as e:
+            got = ('error', str(e))
+        if got != tuple(w):
+            failures.append('%s %s on %s: want %s, got %s' % (name, flags, ints, summary(w), summary(got)))
+    return failures
+
+def assembled(gen, asm, name, source, flags):
+    # the failure, if any, of --binary to match asm on the assembly
+    compiled = subprocess.run([gen] + flags.split(), input=source.encode(), capture_output=True)
+    binary = subprocess.run([gen, '--binary'] + flags.split(), input=source.encode(), capture_output=True)
+    if compiled.returncode:
+        return [] # check says why
+    made = subprocess.run([asm], input=compiled.stdout, capture_output=True)
+    if made.returncode or binary.returncode:
+        # what asm rejects, --binary must reject the same way
+        if (made.returncode, made.stderr) != (binary.returncode, binary.stderr):
+            return ['%s %s: asm gave %d %r, --binary %d %r' % (name, flags, made.returncode, made.stderr.decode().strip(),
+                                                               binary.returncode, binary.stderr.decode().strip())]
+        return []
+    if made.stdout != binary.stdout:
+        return ['%s %s: --binary differs from asm' % (name, flags)]
+    return []
+
+def diagnosed(tools, gen, name, source, want):
+    # the tools whose errors for a wrong program are not the ones wanted
+    failures = []
+    for tool in ([tools['wlp4type']], [gen, '-O2'], [gen, '-O1', '--fused']):
+        checked = subprocess.run(tool, input=source.encode(), capture_output=True)
+        if checked.returncode == 0 or checked.stderr.decode() != want:
+            failures.append('%s %s: errors differ from %s.err:\n%s' % (name, ' '.join(tool[1:]) or 'wlp4type',
+                                                                    name, checked.stderr.decode().strip()))
+    return failures
+
+def cached(wlp4type, name, source):
+    # the failures of wlp4type's cache on one program
+    def check(source, *flags):
+        done = subprocess.run([wlp4type] + list(flags), input=source.encode(), capture_output=True)
+        return done.returncode, done.stdout.decode(), done.stderr.decode()
+    failures = []
+    with tempfile.TemporaryDirectory() as cache:
+        want = check(source)
+        for state in ('cold', 'warm'):
+            got = check(source, '--cache-dir', cache)
+            if got != want:
+                failures.append('%s: %s cache gives %d %r, not %d %r' % (name, state, got[0], got[2].strip(), want[0], want[2].strip()))
+        if want[0]:
+            return failures
+        # the first procedure's return expression, plus 0
+        lines = source.split('\n')
+        at = next(i for i, l in enumerate(lines) if not l.startswith('//') and re.search(r'\breturn [^;]*;', l))
+        lines[at] = re.sub(r'\breturn ([^;]*);', r'return (\1) + 0;', lines[at], count=1)
+        code, _, stats = check('\n'.join(lines), '--cache-dir', cache, '--stats')
+        procedures = int(re.search(r'procedures: (\d+)', stats).group(1))
+        counts = re.search(r'cache hits: (\d+), misses: (\d+)', stats)
+        if code or (int(counts.group(1)), int(counts.group(2))) != (procedures - 1, 1):
+            failures.append('%s: after an edit to one procedure, %s' % (name, counts.group(0) if counts else stats.strip()))
+    return failures
+
+def summary(result):
+    out, ret = result
+    if out == 'error':
+        return 'error ' + ret
+    return '[%s] ret %s' % (' '.join(out[:12]) + (' ...' if len(out) > 12 else ''), ret)
+
+def optimizations(gen):
+    # each optimization, and the level to turn it off at: the IR and its
+    # passes at -O3 -fir, the rest at -O2
+    names = []
+    for level in ('-O2', '-O3 -fir'):
+        listing = subprocess.run([gen] + level.split() + ['--print-passes'], capture_output=True, check=True).stdout.decode()
+        for line in listing.split('\n'):
+            words = line.split()
+            if words[:1] == ['on'] and (words[1] != 'ir') == (level == '-O2'):
+                names.append((words[1], level))
+            elif line.startswith('ir passes:'):
+                for p in words[2].split(','):
+                    if (p, level) not in names:
+                        names.append((p, level))
+    return names
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--seeds', type=int, default=40, help='random programs to try')
+    parser.add_argument('--jobs', type=int, default=os.cpu_count())
+    parser.add_argument('--gen', help='a wlp4gen to test rather than the one built from the tree')
+    args = parser.parse_args()
+    tools = build(os.environ.get('BUILD', os.path.join(root, '_test_build')))
+    os.environ['WLP4PARSE'] = tools['wlp4parse']
+    gen = args.gen or tools['wlp4gen']
+
+    programs = {}
+    directory = os.path.join(here, 'programs')
+    for f in sorted(os.listdir(directory)):
+        if f.endswith('.wlp4'):
+            programs[f[:-5]] = open(os.path.join(directory, f)).read()
+    generated = {'big': fuzz.big(150), 'wide': fuzz.wide(9000)}
+    for seed in range(1, args.seeds + 1):
+        generated['fuzz%d' % seed] = fuzz.Gen(seed).program()
+    programs.update(generated)
+    runs = []
+    offs = ['%s -fno-%s' % (level, name) for name, level in optimizations(gen)]
+    for name in programs:
+        for flags in LEVELS + ([] if name in generated else offs):
+            runs.append((name, flags))
+
+    with concurrent.futures.ProcessPoolExecutor(args.jobs) as pool:
+        want = dict(zip(programs, pool.map(expected, programs.values())))
+        jobs = [pool.submit(check, gen, name, programs[name], flags, want[name]) for name, flags in runs]
+        jobs += [pool.submit(assembled, gen, tools['asm'], name, programs[name], flags)
+                 for name in programs for flags in LEVELS]
+        wrong = os.path.join(here, 'errors')
+        for f in sorted(os.listdir(wrong)):
+            if f.endswith('.wlp4'):
+                source, want = (open(os.path.join(wrong, f[:-5] + ext)).read() for ext in ('.wlp4', '.err'))
+                jobs.append(pool.submit(diagnosed, tools, gen, f[:-5], source, want))
+                jobs.append(pool.submit(cached, tools['wlp4type'], f[:-5], source))
+        jobs += [pool.submit(cached, tools['wlp4type'], name, programs[name]) for name in programs if name not in generated]
+        failures = [f for job in jobs for f in job.result()]
+    for f in failures:
+        print('FAIL', f)
+    print('%d programs, %d compilations, %d failures' % (len(programs), len(runs), len(failures)))
+    return 1 if failures else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+# reference interpreter for WLP4, run over the tree wlp4parse prints, that
+# the generated code is checked against. Every variable gets a word of memory
+# so & and pointer arithmetic behave as on MIPS; ints wrap at 32 bits.
+# usage: wlp4.py [--array] program.wlp4 ints... (wlp4parse from $WLP4PARSE)
+import os, subprocess, sys
+
+sys.setrecursionlimit(1000000)
+
+def s32(x):
+    x &= 0xffffffff
+    return x - (1 << 32) if x & 0x80000000 else x
+
+class Node:
+    __slots__ = ('LH', 'RH', 'ch', 'lex')
+
+def build(lines):
+    it = iter(lines)
+    def node():
+        words = next(it).split()
+        n = Node()
+        n.LH, n.ch = words[0], []
+        if n.LH[0].isupper() and n.LH != '.EMPTY': # a token and its lexeme
+            n.RH, n.lex = [], words[1] if len(words) > 1 else ''
+            return n
+        n.RH, n.lex = [w for w in words[1:] if w != '.EMPTY'], None
+        for _ in n.RH:
+            n.ch.append(node())
+        return n
+    return node()
+
+def listed(node, item, rest):
+    # the items of a right recursive list such as params or arglist
+    out = []
+    while True:
+        out.append(node.ch[item])
+        if len(node.ch) <= rest:
+            return out
+        node = node.ch[rest]
+
+class Interpreter:
+    def __init__(self, root):
+        self.mem, self.next, self.out, self.procs, self.steps = {}, 0x100000, [], {}, 0
+        p = root.ch[1]
+        while len(p.ch) > 1:
+            self.procs[p.ch[0].ch[1].lex] = p.ch[0]
+            p = p.ch[1]
+        self.main = p.ch[0]
+
+    def alloc(self, n):
+        at = self.next
+        self.next += 4 * n
+        for i in range(n):
+            self.mem[at + 4 * i] = 0
+        return at
+
+    def call(self, proc, args):
+        if proc.LH == 'main':
+            params = [proc.ch[3], proc.ch[5]]
+        else:
+            params = listed(proc.ch[3].ch[0], 0, 2) if proc.ch[3].ch else []
+        env = {'__types': {}}
+        def declare(dcl, value):
+            env['__types'][dcl.ch[1].lex] = len(dcl.ch[0].ch) > 1 # type -> INT STAR
+            env[dcl.ch[1].lex] = self.alloc(1)
+            self.mem[env[dcl.ch[1].lex]] = value
+        for dcl, v in zip(params, args):
+            declare(dcl, v)
+        dcls, d = [], proc.ch[-6]
+        while d.ch:
+            dcls.append(d)
+            d = d.ch[0]
+        for d in reversed(dcls):
+            init = d.ch[3]
+            declare(d.ch[1], 1 if init.LH == 'NULL' else s32(int(init.lex)))
+        self.statements(proc.ch[-5], env)
+        return self.expr(proc.ch[-3], env)
+
+    def statements(self, node, env):
+        stmts = []
+        while node.ch:
+            stmts.append(node.ch[1])
+            node = node.ch[0]
+        for s in reversed(stmts):
+            self.statement(s, env)
+
+    def statement(self, s, env):
+        self.steps += 1
+        if self.steps > 5000000:
+            raise Exception('too many steps')
+        kind = s.RH[0]
+        if kind == 'lvalue':
+            at = self.address(s.ch[0], env)
+            self.mem[at] = self.expr(s.ch[2], env)
+        elif kind == 'IF':
+            self.statements(s.ch[5] if self.test(s.ch[2], env) else s.ch[9], env)
+        elif kind == 'WHILE':
+            while self.test(s.ch[2], env):
+                self.statements(s.ch[5], env)
+        elif kind == 'PRINTLN':
+            self.out.append(str(s32(self.expr(s.ch[2], env))))
+        elif kind == 'DELETE':
+            self.expr(s.ch[3], env)
+
+    def test(self, t, env):
+        a, b = self.expr(t.ch[0], env), self.expr(t.ch[2], env)
+        if self.isPointer(t.ch[0], env):
+            a, b = a & 0xffffffff, b & 0xffffffff
+        else:
+            a, b = s32(a), s32(b)
+        return {'EQ': a == b, 'NE': a != b, 'LT': a < b, 'LE': a <= b, 'GE': a >= b, 'GT': a > b}[t.RH[1]]
+
+    def isPointer(self, e, env):
+        if e.LH == 'expr':
+            if len(e.RH) == 1:
+                return self.isPointer(e.ch[0], env)
+            l, r = self.isPointer(e.ch[0], env), self.isPointer(e.ch[2], env)
+            return l != r if e.RH[1] == 'PLUS' else l and not r
+        if e.LH == 'term':
+            return len(e.RH) == 1 and self.isPointer(e.ch[0], env)
+        kind = e.RH[0]
+        if kind == 'ID' and len(e.RH) == 1:
+            return env['__types'][e.ch[0].lex]
+        if kind == 'LPAREN':
+            return self.isPointer(e.ch[1], env)
+        return kind in ('NULL', 'AMP', 'NEW')
+
+    def address(self, lvalue, env):
+        if lvalue.RH == ['ID']:
+            return env[lvalue.ch[0].lex]
+        if lvalue.RH[0] == 'STAR':
+            return self.expr(lvalue.ch[1], env) & 0xffffffff
+        return self.address(lvalue.ch[1], env)
+
+    def expr(self, e, env):
+        if e.LH == 'expr':
+            if len(e.RH) == 1:
+                return self.expr(e.ch[0], env)
+            l, r = self.expr(e.ch[0], env), self.expr(e.ch[2], env)
+            lp, rp = self.isPointer(e.ch[0], env), self.isPointer(e.ch[2], env)
+            if e.RH[1] == 'PLUS':
+                return s32(l + 4 * r if lp else 4 * l + r if rp else l + r)
+            if lp and rp:
+                return s32(s32(l - r) // 4)
+            return s32(l - 4 * r if lp else l - r)
+        if e.LH == 'term':
+            if len(e.RH) == 1:
+                return self.expr(e.ch[0], env)
+            l, r = s32(self.expr(e.ch[0], env)), s32(self.expr(e.ch[2], env))
+            if e.RH[1] == 'STAR':
+                return s32(l * r)
+            if r == 0:
+                raise Exception('division by zero')
+            q = abs(l) // abs(r) # truncating, as div does
+            q = q if (l < 0) == (r < 0) else -q
+            return s32(q) if e.RH[1] == 'SLASH' else s32(l - q * r)
+        kind = e.RH
+        if kind == ['ID']:
+            return self.mem[env[e.ch[0].lex]]
+        if kind == ['NUM']:
+            return s32(int(e.ch[0].lex))
+        if kind == ['NULL']:
+            return 1
+        if kind[0] == 'LPAREN':
+            return self.expr(e.ch[1], env)
+        if kind[0] == 'AMP':
+            return self.address(e.ch[1], env)
+        if kind[0] == 'STAR':
+            at = self.expr(e.ch[1], env) & 0xffffffff
+            if at not in self.mem:
+                raise Exception('bad dereference %x' % at)
+            return self.mem[at]
+        if kind[0] == 'NEW':
+            n = s32(self.expr(e.ch[3], env))
+            return self.alloc(n) if n > 0 else 1
+        args = [self.expr(a, env) for a in listed(e.ch[2], 0, 2)] if len(kind) == 4 else []
+        return self.call(self.procs[e.ch[0].lex], args)
+
+def run(source, ints, array=False):
+    parse = subprocess.run([os.environ.get('WLP4PARSE', 'wlp4parse')], input=source.encode(), capture_output=True)
+    if parse.returncode:
+        raise Exception(parse.stderr.decode().strip())
+    interpreter = Interpreter(build(parse.stdout.decode().strip().split('\n')))
+    if array:
+        base = interpreter.alloc(len(ints))
+        for i, v in enumerate(ints):
+            interpreter.mem[base + 4 * i] = s32(v)
+        args = [base, len(ints)]
+    else:
+        args = [s32(v) for v in ints]
+    result = interpreter.call(interpreter.main, args)
+    return interpreter.out, s32(result)
+
+if __name__ == '__main__':
+    argv = sys.argv[1:]
+    array = argv[:1] == ['--array']
+    if array:
+        argv = argv[1:]
+    out, result = run(open(argv[0]).read(), [int(x) for x in argv[1:]], array)
+    for line in out:
+        print(line)
+    print('ret', result, file=sys.stderr)
@@ -1,14 +1,20 @@
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <deque>
 #include <string>
 #include <vector>
 #include <cctype>
 #include <map>
+#include <set>
 #include <bitset>
 #include<cstdlib>
+#include <chrono>
+#include <algorithm>
 #include "dfa.h"
 #include "wlp4data.h"
+#include "mips.h"
+#include "callgraph.h"
 
 using namespace std;
 
@@ -20,7 +26,11 @@ struct token {
     string type;
     string lexeme;
 
+    int line = 0;
+    int col = 0;
+
     token(string type, string lexeme) : type{type}, lexeme{lexeme} {}
+    token(string type, string lexeme, int line, int col) : type{type}, lexeme{lexeme}, line{line}, col{col} {}
 };
 
 struct DFA {
@@ -41,6 +51,15 @@ struct Tree{
     vector<string> RH;
     string type;
     vector<Tree*> children;
+    int slot = 0; // on ID nodes: frame word of the variable, at slot * 4 from $29
+    bool isConst = false; // set by fold: the expression always has this value
+    int value = 0;
+    Tree * same = nullptr; // set by fold: the expression has the value of this one
+    int need = -1; // registers to evaluate the expression, -1 until labelled
+    bool calls = false; // it calls a procedure or new
+    bool reads = false; // it reads memory a call could change
+    int line = 0; // source position, set on token leaves only
+    int col = 0;
     Tree(string data) {
         istringstream iss{data};
         string s;
@@ -72,6 +91,20 @@ struct Tree{
              
     }
 
+    // position of the first token under this node; false if it covers none
+    bool position(int &l, int &c) {
+        if (children.empty()) {
+            if (line == 0) return false;
+            l = line;
+            c = col;
+            return true;
+        }
+        for (auto &child : children) {
+            if (child->position(l, c)) return true;
+        }
+        return false;
+    }
+
     Tree* getChild(string type, int i) {
         for (int j = 0; j < RH.size(); ++j) {
             if (RH[j] == type) {
@@ -157,6 +190,8 @@ void shift(deque<token> &input, deque<Tree*> &treeStack, deque<int> &stateStack,
   token symbol = input.front() ;
   input.pop_front() ;
   Tree* newNode = new Tree(symbol.type + " " + symbol.lexeme) ;
+  newNode->line = symbol.line;
+  newNode->col = symbol.col;
   treeStack.push_back(newNode) ;
   // cout << "SHIFT Node:" << symbol.type + " " + symbol.lexeme << "\n" ;
   if (transition.find(make_pair(stateStack.back(), symbol.type)) == transition.end()) {
@@ -198,12 +233,48 @@ void tokensToTrees(deque<token> & program, vector<Rule> & cfgRule, SLR & slr, de
   
 }
 
+// type assigned to a node after a type error; anything built from a poisoned
+// operand is poisoned too, without reporting again
+const string POISON = "?";
+
+struct Diagnostic {
+    int line;
+    int col;
+    string message;
+};
+
+// collects semantic errors so one run reports all of them
+struct Diagnostics {
+    vector<Diagnostic> errors;
+    bool first = false; // stop at the first error, as fused mode must
+    void error(Tree *at, string message) {
+        int line = 0, col = 0;
+        if (at) at->position(line, col);
+        errors.push_back(Diagnostic{line, col, message});
+        if (first) throw runtime_error("ERROR: " + to_string(line) + ":" + to_string(col) + ": " + message);
+    }
+    bool empty() { return errors.empty(); }
+    void report(ostream &out) {
+        stable_sort(errors.begin(), errors.end(), [](const Diagnostic &a, const Diagnostic &b) {
+            return a.line < b.line || (a.line == b.line && a.col < b.col);
+        });
+        for (auto &e : errors) {
+            out << "ERROR: " << e.line << ":" << e.col << ": " << e.message << "\n";
+        }
+        out << errors.size() << (errors.size() == 1 ? " error\n" : " errors\n");
+    }
+};
+
+// params sit above the frame pointer (slot > 0), locals below it (slot < 0)
 struct Variable {
     string name;
     string type;
+    int slot;
     Variable() {}
-    Variable(Tree * dcl) {
-        name = (dcl->getChild("ID", 1))->RH[0] ;
+    Variable(Tree * dcl, int slot) : slot{slot} {
+        Tree * id = dcl->getChild("ID", 1) ;
+        name = id->RH[0] ;
+        id->slot = slot ;
         type = "int";
         if ((dcl->getChild("type",1))->children.size() > 1) {
             type = type + "*" ;
@@ -213,54 +284,46 @@ struct Variable {
 
 struct VariableTable {
     map<string,Variable> varTable;
-    void Add(Variable &var) {
+    bool Add(Variable &var) {
         if (varTable.find(var.name) == varTable.end()) {
             varTable[var.name] = var ;
-        } else {
-            throw runtime_error("ERROR: Duplicate variable definition!");
+            return true;
         }
+        return false;
     }
-    Variable & Get(string var) {
-        if (varTable.find(var) != varTable.end()) {
-            return varTable[var];
-        } else {
-            throw runtime_error("ERROR: Undeclared Variable!");
-        }
+    Variable * Find(string var) {
+        auto it = varTable.find(var);
+        return it == varTable.end() ? nullptr : &it->second;
     }
 };
 
 struct Procedure {
     string name;
     vector<string> signature;
-    VariableTable symTable; 
+    VariableTable symTable;
+    int locals = 0;
     Procedure() {}
-    Procedure(Tree * proc) {
+    Procedure(Tree * proc, Diagnostics & diags) {
         if (proc->LH == "main") { // main
             //name
             name = "main" ;
             // param # 1
-            Variable dcl = Variable(proc->getChild("dcl", 1));
-            symTable.Add(dcl);
+            Variable dcl = declare(proc->getChild("dcl", 1), 1, diags);
             signature.push_back(dcl.type);
             // param # 2
-            dcl = Variable(proc->getChild("dcl", 2));
-            if (dcl.type == "int") {
-                symTable.Add(dcl);
-            } else {
-                throw runtime_error("ERROR: main param #2 not int!");
-            }
+            dcl = declare(proc->getChild("dcl", 2), 0, diags);
+            if (dcl.type != "int") diags.error(proc->getChild("dcl", 2), "main param #2 not int") ;
             signature.push_back("int");
         } else { // procedure
             //name
             name = (proc->getChild("ID",1)->RH)[0];
             // params
             Tree *params = proc->getChild("params",1) ;
+            vector<Tree*> paramDcls;
             if (!(params->children).empty()) {
-                params = params->getChild("paramlist",1) ; 
+                params = params->getChild("paramlist",1) ;
                 while (true) {
-                    Variable param = Variable(params->getChild("dcl",1));
-                    symTable.Add(param);
-                    signature.push_back(param.type);
+                    paramDcls.push_back(params->getChild("dcl",1));
                     if ((params->children).size() > 1) {
                         params = params->getChild("paramlist",1);
                     } else {
@@ -268,31 +331,50 @@ struct Procedure {
                     }
                 }
             }
+            // the first argument is pushed first so it is furthest from $29
+            int n = paramDcls.size();
+            for (int i = 0; i < n; ++i) {
+                Variable param = declare(paramDcls[i], n - i, diags);
+                signature.push_back(param.type);
+            }
         }
         Tree *dcls = proc->getChild("dcls", 1);
+        for (Tree *d = dcls; !(d->children).empty(); d = d->getChild("dcls",1)) {
+            ++locals;
+        }
+        // dcls is left recursive, so the outermost node is the last declaration
+        int slot = -locals;
         while (true) {
             if ((dcls->children).empty()) {
                 break;
             } else {
-                Variable var = Variable(dcls->getChild("dcl",1)) ;
+                Variable var = declare(dcls->getChild("dcl",1), slot++, diags) ;
                 string value = dcls->RH[3];
-                if (var.type == "int" && value == "NULL")  throw runtime_error("ERROR: wrong type for declaration") ;
-                if (var.type == "int*" && value == "NUM")  throw runtime_error("ERROR: wrong type for declaration") ;
-                symTable.Add(var);
+                if (var.type == "int" && value == "NULL")  diags.error(dcls->getChild("dcl",1), "wrong type for declaration of " + var.name) ;
+                if (var.type == "int*" && value == "NUM")  diags.error(dcls->getChild("dcl",1), "wrong type for declaration of " + var.name) ;
                 dcls = dcls->getChild("dcls",1);
             }
         }
     }
+    Variable declare(Tree * dcl, int slot, Diagnostics & diags) {
+        Variable var = Variable(dcl, slot);
+        if (!symTable.Add(var)) diags.error(dcl, "duplicate variable definition " + var.name);
+        return var;
+    }
 };
 
 struct ProcedureTable {
     map<string, Procedure> procTable;
-    void Add(Procedure &proc) {
+    bool Add(Procedure &proc) {
         if (procTable.find(proc.name) == procTable.end()) {
             procTable[proc.name] = proc ;
-        } else {
-            throw runtime_error("ERROR: Duplicate procedure definition!");
+            return true;
         }
+        return false;
+    }
+    Procedure * Find(string proc) {
+        auto it = procTable.find(proc);
+        return it == procTable.end() ? nullptr : &it->second;
     }
     Procedure &Get(string proc) {
         if (procTable.find(proc) != procTable.end()) {
@@ -303,136 +385,187 @@ struct ProcedureTable {
     }
 };
 
-void checkStatements(Tree* subTree) {
+// checks one statement whose expressions have already been typed
+void checkStatement(Tree* statement, Diagnostics & diags) {
+    int n = statement->RH.size() ;
+    if (n == 4) { // lvalue BECOMES expr SEMI
+        string lhs = statement->getChild("lvalue",1)->type ;
+        string rhs = statement->getChild("expr",1)->type ;
+        if (lhs != rhs && lhs != POISON && rhs != POISON) diags.error(statement, "lvalue BECOMES expr types are not the same") ;
+    } else if (n == 5) {
+        string type = statement->getChild("expr", 1)->type ;
+        if (statement->RH[0] == "PRINTLN") { // PRINTLN
+            if (type != "int" && type != POISON) diags.error(statement, "PRINTLN expr type not int") ;
+        } else { // DELETE
+            if (type != "int*" && type != POISON) diags.error(statement, "DELETE expr type not int*") ;
+        }
+    } else { // WHILE or IF
+        // test
+        Tree* test = statement->getChild("test", 1) ;
+        string lhs = test->getChild("expr",1)->type ;
+        string rhs = test->getChild("expr",2)->type ;
+        if (lhs != rhs && lhs != POISON && rhs != POISON) diags.error(test, "expr types are not the same in test") ;
+    }
+}
+
+void checkStatements(Tree* subTree, Diagnostics & diags) {
     if (!(subTree->RH).empty()) {
         // statements
-        checkStatements(subTree->getChild("statements",1)) ;
+        checkStatements(subTree->getChild("statements",1), diags) ;
         // statement
         Tree *statement = subTree->getChild("statement",1) ;
         // cout << statement->LH ;
         // for (auto &c : statement->RH) {
         //   cout << " " << c;
         // } cout << endl;
-        
-        int n = statement->RH.size() ;
-        if (n == 4) { // lvalue BECOMES expr SEMI
-            if (statement->getChild("lvalue",1)->type != statement->getChild("expr",1)->type) throw runtime_error("ERROR: lvalue BECOMES expr types are not the same in test!") ;
-        } else if (n == 5) { 
-            if (statement->RH[0] == "PRINTLN") { // PRINTLN
-                if (statement->getChild("expr", 1)->type != "int") throw runtime_error("ERROR: PRINTLN expr type not int!") ;
-            } else { // DELETE
-                if (statement->getChild("expr",1)->type != "int*") throw runtime_error("ERROR: DELETE expr type not int*!") ;
-            }
-        } else { // WHILE or IF
-            // test
-            Tree* test = statement->getChild("test", 1) ;
-            if ((test->getChild("expr",1))->type != (test->getChild("expr",2))->type) throw runtime_error("ERROR: expr types are not the same in test!") ;
+        checkStatement(statement, diags) ;
+        if (statement->RH.size() > 5) { // WHILE or IF
             if (statement->children[0]->LH == "IF") { // IF
-                checkStatements(statement->getChild("statements",1));
-                checkStatements(statement->getChild("statements",2));
+                checkStatements(statement->getChild("statements",1), diags);
+                checkStatements(statement->getChild("statements",2), diags);
             } else { // WHILE
-                checkStatements(statement->getChild("statements",1));
+                checkStatements(statement->getChild("statements",1), diags);
             }
         }
     }
 }
 
-void annoteTypes(Tree* subTree, VariableTable & vars, ProcedureTable & procs) {
-    // cout << subTree->LH ;
-    // for (auto &c : subTree->RH) {
-    //   cout << " " << c;
-    // } cout << endl;
-    for (auto &c: subTree->children) {
-      annoteTypes(c, vars, procs) ;
+// the only name lookup for a variable use; codegen reads id->slot afterwards
+void resolve(Tree * id, VariableTable & vars, Diagnostics & diags) {
+    Variable *var = vars.Find(id->RH[0]);
+    if (!var) {
+        diags.error(id, "undeclared variable " + id->RH[0]);
+        id->type = POISON;
+        return;
+    }
+    id->type = var->type;
+    id->slot = var->slot;
+}
+
+// type of a call to id, or POISON after reporting why it is not a valid callee
+string calleeType(Tree * call, VariableTable & vars, ProcedureTable & procs, Diagnostics & diags, Procedure * & callee) {
+    string id = (call->getChild("ID", 1))->RH[0] ;
+    callee = nullptr;
+    if (id == "main") {
+        diags.error(call, "function wain cannot be called recursively");
+        return POISON;
+    }
+    if (vars.Find(id)) {
+        diags.error(call, "variable " + id + " called as procedure");
+        return POISON;
     }
+    callee = procs.Find(id);
+    if (!callee) {
+        diags.error(call, "undeclared procedure " + id);
+        return POISON;
+    }
+    return "int";
+}
+
+// types one node from the types of its children
+void annoteNode(Tree* subTree, VariableTable & vars, ProcedureTable & procs, Diagnostics & diags) {
     if (subTree->LH == "NUM") {
         subTree->type = "int";
     } else if (subTree->LH == "NULL") {
         subTree->type = "int*";
     } else if (subTree->LH == "factor") {
-        string id;
+        string type;
+        Procedure *callee;
         switch ((subTree->RH).size()) {
             case 1:
                 if (subTree->RH[0] == "ID") { // ID
-                    subTree->type = (vars.Get((subTree->getChild("ID",1)->RH)[0])).type ;
-                    
+                    resolve(subTree->getChild("ID",1), vars, diags) ;
+                    subTree->type = subTree->getChild("ID",1)->type ;
+
                 } else { // NUM NULL
                     subTree->type = ((subTree->children)[0])->type ;
                 }
                 break;
             case 2:
                 if (subTree->RH[0] == "AMP") { // AMP lvalue
-                    if (subTree->getChild("lvalue", 1)->type == "int") {
+                    type = subTree->getChild("lvalue", 1)->type ;
+                    if (type == "int") {
                         subTree->type = "int*" ;
                     } else {
-                        throw runtime_error("ERROR: factor -> AMP lvalue where lvalue type is not int") ;
+                        if (type != POISON) diags.error(subTree, "factor -> AMP lvalue where lvalue type is not int") ;
+                        subTree->type = POISON ;
                     }
                 } else { // STAR factor
-                    if (subTree->getChild("factor",1)->type == "int*") {
+                    type = subTree->getChild("factor",1)->type ;
+                    if (type == "int*") {
                         subTree->type = "int" ;
                     } else {
-                        throw runtime_error("ERROR: factor -> STAR factor where factor type is not int*") ;
+                        if (type != POISON) diags.error(subTree, "factor -> STAR factor where factor type is not int*") ;
+                        subTree->type = POISON ;
                     }
                 }
                 break;
             case 3:
                 if (subTree->RH[0] == "ID") { // ID LPAREN RPAREN
-                    id = (subTree->getChild("ID", 1))->RH[0] ;
-                    if (id == "main") throw runtime_error("ERROR: function wain cannot be called recursively!") ;
-                    // cout << "id: " << id << endl;
-                    if (vars.varTable.find(id) == vars.varTable.end()) { // check
-                        if (procs.Get(id).signature.size() > 0) throw runtime_error("ERROR: wrong number of variables in empty procedure " + id) ;
-                        subTree->type = "int" ;
-                    } else {
-                        throw runtime_error("ERROR: variable " + id + " called as procedure");
+                    subTree->type = calleeType(subTree, vars, procs, diags, callee) ;
+                    if (callee && callee->signature.size() > 0) {
+                        diags.error(subTree, "wrong number of arguments to procedure " + callee->name) ;
+                        subTree->type = POISON ;
                     }
                 } else { // LPAREN expr RPAREN
                   subTree->type = (subTree->getChild("expr",1))->type;
                 }
                 break;
-            case 4: // ID LPAREN arglist RPAREN      
-                id = (subTree->getChild("ID", 1))->RH[0] ;
-                if (id == "main") throw runtime_error("ERROR: function wain cannot be called recursively!") ;
-                if (vars.varTable.find(id) == vars.varTable.end()) { // check
-                    Tree *args = subTree->getChild("arglist",1) ; 
-                    vector<string> sign = procs.Get(id).signature ;
+            case 4: // ID LPAREN arglist RPAREN
+                subTree->type = calleeType(subTree, vars, procs, diags, callee) ;
+                if (callee) {
+                    Tree *args = subTree->getChild("arglist",1) ;
+                    vector<string> &sign = callee->signature ;
                     int n = sign.size() ;
-                    if (n == 0) throw runtime_error("ERROR: too many parameters");
-                    for (int i = 0; i < n ; ++i) {
-                        if (sign[i] != (args->getChild("expr",1))->type) throw runtime_error("ERROR: arglist does not match procedure " + id + " signature") ; 
-                        if (i != n - 1) {
-                            if ((args->children).size() > 1) {
-                                args = args->getChild("arglist",1) ;     
-                            } else {
-                                throw runtime_error("ERROR: not enough arguments");
-                            }
+                    int i = 0;
+                    while (true) {
+                        string argType = (args->getChild("expr",1))->type ;
+                        if (i >= n) {
+                            diags.error(subTree, "too many arguments to procedure " + callee->name);
+                            subTree->type = POISON ;
+                            break;
+                        }
+                        if (sign[i] != argType && argType != POISON) {
+                            diags.error(args, "argument " + to_string(i + 1) + " does not match procedure " + callee->name + " signature") ;
+                            subTree->type = POISON ;
+                        }
+                        ++i;
+                        if ((args->children).size() > 1) {
+                            args = args->getChild("arglist",1) ;
                         } else {
-                            if ((args->children).size() > 1) throw runtime_error("ERROR: too many arguments");
+                            if (i < n) {
+                                diags.error(subTree, "not enough arguments to procedure " + callee->name);
+                                subTree->type = POISON ;
+                            }
+                            break;
                         }
-                    }   
-                    subTree->type = "int" ;
-                } else {
-                    throw runtime_error("ERROR: variable " + id + " called as procedure");
+                    }
                 }
                 break;
             case 5: // NEW INT LBRACK expr RBRACK
-                if (subTree->getChild("expr",1)->type == "int") {
+                type = subTree->getChild("expr",1)->type ;
+                if (type == "int") {
                         subTree->type = "int*" ;
                 } else {
-                    throw runtime_error("ERROR: factor -> NEW INT LBRACK expr RBRACK where expr type is not int") ;
+                    if (type != POISON) diags.error(subTree, "factor -> NEW INT LBRACK expr RBRACK where expr type is not int") ;
+                    subTree->type = POISON ;
                 }
                 break;
         }
     } else if (subTree->LH == "lvalue") {
+        string type;
         switch ((subTree->RH).size()) {
             case 1: // ID
-                subTree->type = (vars.Get((subTree->getChild("ID",1)->RH)[0])).type ;
+                resolve(subTree->getChild("ID",1), vars, diags) ;
+                subTree->type = subTree->getChild("ID",1)->type ;
                 break;
             case 2: // STAR factor
-                if (subTree->getChild("factor", 1)->type == "int*") {
+                type = subTree->getChild("factor", 1)->type ;
+                if (type == "int*") {
                     subTree->type = "int" ;
                 } else {
-                    throw runtime_error("ERROR: lvalue -> STAR factor where factor type is not int*") ;
+                    if (type != POISON) diags.error(subTree, "lvalue -> STAR factor where factor type is not int*") ;
+                    subTree->type = POISON ;
                 }
                 break ;
             case 3: // ( lvalue )
@@ -443,8 +576,14 @@ void annoteTypes(Tree* subTree, VariableTable & vars, ProcedureTable & procs) {
         if ((subTree->RH).size() == 1) {// term -> factor
             subTree->type = (subTree->getChild("factor", 1))->type ;
         } else { // term -> term [] factor
-            if (subTree->getChild("term", 1)->type != "int" || subTree->getChild("factor", 1)->type != "int") throw runtime_error("ERROR: term -> term factor not both type int") ;
-            subTree->type = "int" ;
+            string termType = subTree->getChild("term", 1)->type ;
+            string factorType = subTree->getChild("factor", 1)->type ;
+            if (termType == "int" && factorType == "int") {
+                subTree->type = "int" ;
+            } else {
+                if (termType != POISON && factorType != POISON) diags.error(subTree, "term -> term factor not both type int") ;
+                subTree->type = POISON ;
+            }
         }
     } else if (subTree->LH == "expr") {
         if ((subTree->RH).size() == 1) {
@@ -452,116 +591,368 @@ void annoteTypes(Tree* subTree, VariableTable & vars, ProcedureTable & procs) {
         } else {
             string exprType = subTree->getChild("expr",1)->type ;
             string termType = subTree->getChild("term",1)->type ;
-            if (subTree->children[1]->LH == "PLUS") {
-                if (exprType == "int*" && termType == "int*") throw runtime_error("ERROR: expr -> expr PLUS term both type int*") ;
-                subTree->type = (exprType == "int" && termType == "int") ? "int" : "int*" ;
+            if (exprType == POISON || termType == POISON) {
+                subTree->type = POISON ;
+            } else if (subTree->children[1]->LH == "PLUS") {
+                if (exprType == "int*" && termType == "int*") {
+                    diags.error(subTree, "expr -> expr PLUS term both type int*") ;
+                    subTree->type = POISON ;
+                } else {
+                    subTree->type = (exprType == "int" && termType == "int") ? "int" : "int*" ;
+                }
             } else {
-                if (exprType == "int" && termType == "int*") throw runtime_error("ERROR: expr -> expr PLUS term both type int") ;
-                subTree->type = (exprType == "int*" && termType == "int") ? "int*" : "int" ;
+                if (exprType == "int" && termType == "int*") {
+                    diags.error(subTree, "expr -> expr MINUS term is int - int*") ;
+                    subTree->type = POISON ;
+                } else {
+                    subTree->type = (exprType == "int*" && termType == "int") ? "int*" : "int" ;
+                }
             }
-        } 
+        }
     }  // cout << "--" << subTree->LH << "-- type:" << subTree->type << endl;
 }
 
-void collectProcedures(Tree *procTree, ProcedureTable & procs) {
+void annoteTypes(Tree* subTree, VariableTable & vars, ProcedureTable & procs, Diagnostics & diags) {
+    // cout << subTree->LH ;
+    // for (auto &c : subTree->RH) {
+    //   cout << " " << c;
+    // } cout << endl;
+    for (auto &c: subTree->children) {
+      annoteTypes(c, vars, procs, diags) ;
+    }
+    annoteNode(subTree, vars, procs, diags) ;
+}
+
+// the return expression of a typed procedure must be an int
+void checkReturn(Tree *proc, Diagnostics & diags) {
+    string type = (proc->getChild("expr", 1))->type ;
+    if (type != "int" && type != POISON) diags.error(proc->getChild("expr", 1), "return expr type is not int") ;
+}
+
+// type checks one procedure body against its own symbol table
+void checkProcedure(Tree *proc, VariableTable &vars, ProcedureTable &procs, Diagnostics &diags) {
+    annoteTypes(proc, vars, procs, diags) ;
+    checkStatements(proc->getChild("statements",1), diags);
+    checkReturn(proc, diags);
+}
+
+void collectProcedures(Tree *procTree, ProcedureTable & procs, Diagnostics & diags) {
     Tree * proc ;
     while (true) {
         if (procTree->children.size() > 1) {
             proc = procTree->getChild("procedure",1) ;
-            Procedure newProc = Procedure(proc);
+            Procedure newProc = Procedure(proc, diags);
             // for (auto it = newProc.symTable.varTable.begin(); it != newProc.symTable.varTable.end(); it++) {
             //   cout << "String: " << it->first << endl;
             //   cout << "Variable: " << (it->second).name << endl;
             //   cout << "Type: " << (it->second).type << endl;
             // }
-            procs.Add(newProc) ;
-            annoteTypes(proc, newProc.symTable, procs) ;
-            checkStatements(proc->getChild("statements",1));
-            if ((proc->getChild("expr", 1))->type != "int") throw runtime_error("ERROR: expr type is not int!") ;
+            if (!procs.Add(newProc)) diags.error(proc->getChild("ID",1), "duplicate procedure definition " + newProc.name) ;
+            checkProcedure(proc, newProc.symTable, procs, diags) ;
             procTree = procTree->getChild("procedures",1) ;
         } else { // main
             proc = procTree->getChild("main",1) ;
             // proc->print();
-            Procedure newProc = Procedure(proc); //
+            Procedure newProc = Procedure(proc, diags); //
             procs.Add(newProc) ;
-            Procedure procedure = procs.Get("main") ;
-            annoteTypes(proc, procedure.symTable, procs) ;
-            //cout << "HMMMM\n";
-            checkStatements(proc->getChild("statements",1));
-            //cout << "HMMMMmmm\n";
-            if ((proc->getChild("expr", 1))->type != "int") throw runtime_error("ERROR: expr type is not int!") ;
+            checkProcedure(proc, newProc.symTable, procs, diags) ;
             break;
         }
     }
 };
 
+double secondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
 // OMG HELPER PRINTING FUNCTIONS
+// the helpers append instruction records to the current procedure; text is
+// produced once, at the end, by Emitter::write
+
+// ADD..SW are in MIPS_OPS order, so MIPS_OPS[op] encodes them
+enum Op : unsigned char {
+  ADD, SUB, SLT, SLTU, MULT, MULTU, DIV, DIVU, MFHI, MFLO, LIS,
+  BEQ, BNE, JR, JALR, LW, SW, WORD, LABEL, IMPORT
+};
+
+struct Instr {
+  Op op;
+  unsigned char d, s, t;
+  bool isLabel; // imm is a label id rather than a number
+  int imm;      // immediate, .word value or label id
+};
+
+struct Emitter {
+  vector<string> labelNames;    // label id -> name, empty for fresh labels
+  map<string, int> labelIds;
+  vector<vector<Instr>> procs;  // prologue first, then one vector per procedure
+
+  int label(string name) {
+    auto it = labelIds.find(name);
+    if (it != labelIds.end()) return it->second;
+    labelIds[name] = labelNames.size();
+    labelNames.push_back(name);
+    return labelNames.size() - 1;
+  }
+  // a new label for codegen; it only gets a name, L<id>, if text is written,
+  // and ids count up from the start of each run so output is reproducible
+  int fresh() {
+    labelNames.push_back("");
+    return labelNames.size() - 1;
+  }
+  void appendLabel(string &buf, int id);
+  void appendInstr(string &buf, const Instr &i);
+  string labelName(int id) {
+    string name;
+    appendLabel(name, id);
+    return name;
+  }
+  void begin() { procs.push_back(vector<Instr>()); }
+  void emit(Op op, int d, int s, int t, int imm = 0, bool isLabel = false) {
+    if (procs.empty()) begin();
+    procs.back().push_back(Instr{op, (unsigned char) d, (unsigned char) s, (unsigned char) t, isLabel, imm});
+  }
+  size_t size() {
+    size_t n = 0;
+    for (auto &p : procs) n += p.size();
+    return n;
+  }
+  // what block b assembles to
+  long bytes(int b) {
+    long n = 0;
+    for (auto &i : procs[b]) n += i.op != LABEL && i.op != IMPORT;
+    return 4 * n;
+  }
+  // removes the given blocks
+  void drop(vector<int> blocks) {
+    sort(blocks.rbegin(), blocks.rend());
+    blocks.erase(unique(blocks.begin(), blocks.end()), blocks.end());
+    for (int b: blocks) procs.erase(procs.begin() + b);
+  }
+
+  // text is built in one buffer and handed to the stream in a single write
+  void write(ostream &out);
+  // the bytes asm.cc makes of write()'s text, without the text
+  void writeBinary(ostream &out);
+};
+
+Emitter emitter;
+map<string, int> procBlock; // emitter block of each procedure, wain's under "main"
+
+void appendInt(string &buf, int v) {
+  char tmp[12];
+  int n = 0;
+  unsigned int u = v < 0 ? 0u - (unsigned int) v : v;
+  do {
+    tmp[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  if (v < 0) buf += '-';
+  while (n) buf += tmp[--n];
+}
+void appendReg(string &buf, int r) {
+  buf += '$';
+  appendInt(buf, r);
+}
+
+void Emitter::appendLabel(string &buf, int id) {
+  if (labelNames[id].empty()) {
+    buf += 'L';
+    appendInt(buf, id);
+  } else {
+    buf += labelNames[id];
+  }
+}
+
+void Emitter::appendInstr(string &buf, const Instr &i) {
+  static const char *names[] = {
+    "add", "sub", "slt", "sltu", "mult", "multu", "div", "divu", "mfhi", "mflo", "lis",
+    "beq", "bne", "jr", "jalr", "lw", "sw", ".word", "", ".import"
+  };
+  switch (i.op) {
+    case ADD: case SUB: case SLT: case SLTU:
+      buf += names[i.op]; buf += ' ';
+      appendReg(buf, i.d); buf += ", ";
+      appendReg(buf, i.s); buf += ", ";
+      appendReg(buf, i.t);
+      break;
+    case MULT: case MULTU: case DIV: case DIVU:
+      buf += names[i.op]; buf += ' ';
+      appendReg(buf, i.s); buf += ", ";
+      appendReg(buf, i.t);
+      break;
+    case MFHI: case MFLO: case LIS:
+      buf += names[i.op]; buf += ' ';
+      appendReg(buf, i.d);
+      break;
+    case JR: case JALR:
+      buf += names[i.op]; buf += ' ';
+      appendReg(buf, i.s);
+      break;
+    case BEQ: case BNE:
+      buf += names[i.op]; buf += ' ';
+      appendReg(buf, i.s); buf += ", ";
+      appendReg(buf, i.t); buf += ", ";
+      if (i.isLabel) {
+        appendLabel(buf, i.imm);
+      } else {
+        appendInt(buf, i.imm);
+      }
+      break;
+    case LW: case SW:
+      buf += names[i.op]; buf += ' ';
+      appendReg(buf, i.t); buf += ", ";
+      appendInt(buf, i.imm); buf += '(';
+      appendReg(buf, i.s); buf += ')';
+      break;
+    case WORD:
+      buf += ".word ";
+      if (i.isLabel) {
+        appendLabel(buf, i.imm);
+      } else {
+        appendInt(buf, i.imm);
+      }
+      break;
+    case LABEL:
+      appendLabel(buf, i.imm); buf += ':';
+      break;
+    case IMPORT:
+      buf += ".import "; buf += labelNames[i.imm];
+      break;
+  }
+}
+
+void Emitter::write(ostream &out) {
+  string buf;
+  buf.reserve(size() * 16);
+  for (auto &proc : procs) {
+    for (auto &i : proc) {
+      appendInstr(buf, i);
+      buf += '\n';
+    }
+  }
+  out.write(buf.data(), buf.size());
+  out.flush();
+}
+
+// one pass over the records; references to labels not yet placed are
+// backpatched at the end. Imported symbols are left as 0 for the linker
+void Emitter::writeBinary(ostream &out) {
+  struct Fixup {
+    int at;
+    int label;
+  };
+  vector<long> address(labelNames.size(), -1);
+  vector<bool> imported(labelNames.size(), false);
+  vector<unsigned> words;
+  vector<Fixup> fixups;
+  words.reserve(size());
+  for (auto &proc : procs) {
+    for (auto &i : proc) {
+      if (i.op == LABEL) {
+        address[i.imm] = 4 * words.size();
+      } else if (i.op == IMPORT) {
+        imported[i.imm] = true;
+      } else if (i.isLabel) { // .word or branch to a label
+        fixups.push_back(Fixup{(int) words.size(), i.imm});
+        words.push_back(i.op == WORD ? 0 : encodeMips(MIPS_OPS[i.op], i.d, i.s, i.t, 0));
+      } else if (i.op == WORD) {
+        words.push_back(i.imm);
+      } else {
+        // as asm would reject the text, say a frame offset past 32767
+        if (i.imm < -32768 || i.imm > 32767) throw runtime_error("ERROR: immediate not in range");
+        words.push_back(encodeMips(MIPS_OPS[i.op], i.d, i.s, i.t, i.imm));
+      }
+    }
+  }
+  for (auto &f : fixups) {
+    long at = address[f.label];
+    bool branch = (words[f.at] >> 26) != 0;
+    if (at < 0 && !(imported[f.label] && !branch)) {
+      throw runtime_error("ERROR: Label " + labelName(f.label) + " not found");
+    }
+    if (!branch) {
+      words[f.at] = at < 0 ? 0 : at;
+    } else {
+      long offset = (at - 4 * f.at - 4) / 4;
+      if (offset < -32768 || offset > 32767) throw runtime_error("ERROR: immediate not in range");
+      words[f.at] |= offset & 0xFFFF;
+    }
+  }
+  string buf;
+  buf.reserve(4 * words.size());
+  for (unsigned w : words) {
+    appendWord(buf, w);
+  }
+  out.write(buf.data(), buf.size());
+  out.flush();
+}
 
 void Add(int d, int s, int t) { 
-  cout << "add $" << d << ", $" << s << ", $" << t << "\n"; 
+  emitter.emit(ADD, d, s, t);
 }
 void Sub(int d, int s, int t) { 
-  cout << "sub $" << d << ", $" << s << ", $" << t << "\n"; 
+  emitter.emit(SUB, d, s, t);
 }
 void Slt(int d, int s, int t) { 
-  cout << "slt $" << d << ", $" << s << ", $" << t << "\n"; 
+  emitter.emit(SLT, d, s, t);
 }
 void Sltu(int d, int s, int t) { 
-  cout << "sltu $" << d << ", $" << s << ", $" << t << "\n"; 
+  emitter.emit(SLTU, d, s, t);
 }
 void Mult(int s, int t) { 
-  cout << "mult $"<< s << ", $" << t << "\n"; 
+  emitter.emit(MULT, 0, s, t);
 }
 void Multu(int s, int t) { 
-  cout << "multu $"<< s << ", $" << t << "\n"; 
+  emitter.emit(MULTU, 0, s, t);
 }
 void Div(int s, int t) { 
-  cout << "div $"<< s << ", $" << t << "\n"; 
+  emitter.emit(DIV, 0, s, t);
 }
 void Divu(int s, int t) { 
-  cout << "divu $"<< s << ", $" << t << "\n"; 
+  emitter.emit(DIVU, 0, s, t);
 }
 void Mfhi(int d) { 
-  cout << "mfhi $"<< d << "\n"; 
+  emitter.emit(MFHI, d, 0, 0);
 }
 void Mflo(int d) { 
-  cout << "mflo $"<< d << "\n"; 
+  emitter.emit(MFLO, d, 0, 0);
 }
 void Lis(int d) { 
-  cout << "lis $"<< d << "\n"; 
+  emitter.emit(LIS, d, 0, 0);
 }
-void Beq(int s, int t, string label) { 
-  cout << "beq $" << s << ", $" << t << ", " << label << endl; 
-}
-void Beq(int s, int t, int imm) { 
-  cout << "beq $" << s << ", $" << t << ", " << imm << endl; 
+void Beq(int s, int t, int label) { // to label id
+  emitter.emit(BEQ, 0, s, t, label, true);
 }
-void Bne(int s, int t, string label) { 
-  cout << "bne $" << s << ", $" << t << ", " << label << endl; 
+void Beq(int s, int t, string label) { 
+  Beq(s, t, emitter.label(label));
 }
-void Bne(int s, int t, int imm) { 
-  cout << "bne $" << s << ", $" << t << ", " << imm << endl; 
+void Bne(int s, int t, int label) { 
+  emitter.emit(BNE, 0, s, t, label, true);
 }
 void Jr(int s) { 
-  cout << "jr $"  << s << endl; 
+  emitter.emit(JR, 0, s, 0);
 }
 void Jalr(int s) { 
-  cout << "jalr $"  << s << endl; 
+  emitter.emit(JALR, 0, s, 0);
 }
 void Lw(int t, int imm, int s) {
-  cout << "lw $" << t << ", " << imm << "($" << s << ")" << endl;
+  emitter.emit(LW, 0, s, t, imm);
 }
 void Sw(int t, int imm, int s) {
-  cout << "sw $" << t << ", " << imm << "($" << s << ")" << endl;
+  emitter.emit(SW, 0, s, t, imm);
 }
 void Word(int i) {
-  std::cout << ".word " << i << endl;
+  emitter.emit(WORD, 0, 0, 0, i);
 }
 void Word(string label) {
-  cout << ".word " + label << endl;
+  emitter.emit(WORD, 0, 0, 0, emitter.label(label), true);
+}
+void Label(int id) {
+  emitter.emit(LABEL, 0, 0, 0, id, true);
 }
 void Label(string name) {
-  cout << name + ":" << endl;
+  Label(emitter.label(name));
 }
 void push(int s){ // pushes value from $s
   Sw(s,-4,30);
@@ -575,340 +966,3646 @@ void pop() {
   Add(30,4,30);
 }
 void constant(int s, int word) {
-  cout << "lis $" << s << endl;
+  Lis(s);
   Word(word) ;
 }
 void Import(string func) {
-  cout << ".import " + func << endl;
+  emitter.emit(IMPORT, 0, 0, 0, emitter.label(func), true);
 }
+// from -O1 each procedure that calls keeps $31 in its frame, and one with a
+// frame keeps its caller's $29 there too, so calls don't push and pop them
+bool calleeLinks = false;
+long leafProcs = 0;      // procedures that keep no $31
+long framelessProcs = 0; // of those, ones that don't set $29 either
 void Call(string func) {  
   Lis(5);
-  Word("new");
-  push(31);
+  Word(func);
+  if (!calleeLinks) push(31);
   Jalr(5);
-  pop(31);
-  Add(31,0,5);
+  if (!calleeLinks) pop(31);
 }
-void Flush(int offset) {
+void Flush(int offset) { // pops offset bytes off the stack
   constant(5, offset);
   Add(30,30,5);
 }
+void Reserve(int offset) { // makes room for offset bytes on the stack
+  if (offset <= 8) {
+    for (; offset > 0; offset -= 4) Sub(30,30,4);
+  } else {
+    constant(5, offset);
+    Sub(30,30,5);
+  }
+}
+void Release(int offset) { // what Reserve made room for
+  if (offset <= 8) {
+    for (; offset > 0; offset -= 4) Add(30,30,4);
+  } else {
+    Flush(offset);
+  }
+}
 
-void declarations(Tree* dcls, map<string, int> &offsetTable, int &offset) { // offset contains next avialble memory addr
-  if (!((dcls->children).empty())) {
-    cout << "Here" << endl ;
-    declarations(dcls->getChild("dcls",1), offsetTable, offset) ;
-    cout << "Here" << endl ;
-    Tree* dcl = (dcls->getChild("dcl",1))->getChild("ID",1);
-    cout << "Here" << endl ;
-    string id = dcl->getChild("ID",1)->RH[0] ;
-    cout << "Here" << endl ;
-    if (dcl->type == "int*") {
-      cout << "Here" << endl ;
-      constant(5,1);
-      push(5);
-      offsetTable[id] = offset;
-      offset -= 4;
-    } else {
-      cout << "Here" << endl ;
-      constant(5,stoll(dcls->getChild("NUM",1)->RH[0]));
-      push(5);
-      offsetTable[id] = offset;
-      offset -= 4;
-    }
+// peephole rewriting of each procedure's instructions before they are written.
+// Every instruction is appended to the output and then the table is tried on
+// the tail until nothing matches, so a rewrite can set up the next one. Only
+// the last WINDOW instructions are ever looked at. $5 is scratch and is never
+// live across a branch or label, which the branch patterns rely on
+const int WINDOW = 8;
+bool isReg(const Instr & i, Op op, int d, int s, int t) {
+  return i.op == op && i.d == d && i.s == s && i.t == t;
+}
+bool isMem(const Instr & i, Op op, int t, int imm, int s) {
+  return i.op == op && i.t == t && i.imm == imm && i.s == s;
+}
+bool sameWord(const Instr & a, const Instr & b) {
+  return a.op == WORD && b.op == WORD && a.imm == b.imm && a.isLabel == b.isLabel;
+}
+bool writes(const Instr & i, int r) {
+  switch (i.op) {
+    case ADD: case SUB: case SLT: case SLTU: case MFHI: case MFLO: case LIS:
+      return i.d == r;
+    case LW:
+      return i.t == r;
+    case JALR: // the callee may change it
+      return true;
+    default:
+      return false;
   }
 }
-void aCode(Tree * aExpr, map<string, int> & varTable) { // evaluates expr and stores value in $3
-  // accepts expr, factor, term, lvalue ; offset is next avaliable memory from frame pointer
-  int n = aExpr->RH.size();
-  
-  if (aExpr->LH == "expr") {
-    // cout << "expr?" << endl;
-    if (aExpr->RH.size() == 1) { // -> term
-        aCode(aExpr->getChild("term",1),varTable) ;
-    } else { // -> expr PLUS/MINUS term
-        // $5 <- expr
-        // $3 <-term
-        aCode (aExpr->getChild("expr",1),varTable); 
-        push(3);
-        aCode(aExpr->getChild("term",1),varTable);
-        pop(5);
-        if (aExpr->children[1]->LH == "PLUS") { //PLUS   
-          if (aExpr->getChild("expr",1)->type == "int*") { // int* + int
-            Mult(3,4);
-            Mflo(3);
-          } 
-          if (aExpr->getChild("term",1)->type == "int*") { // int + int*
-            Mult(5,4);
-            Mflo(5);
-          }
-          Add(3,5,3);
-        } else { // MINUS
-          if (aExpr->getChild("term",1)->type == "int") { // int(*) - int
-            if (aExpr->getChild("expr",1)->type == "int*") {
-              Mult(3,4);
-              Mflo(3);
-            }
-            Sub(3,5,3);
-          } else {
-            Sub(3,5,3);
-            Div(3,4);
-            Mflo(3);
+Instr move(int d, int s) {
+  return Instr{ADD, (unsigned char) d, (unsigned char) s, 0, false, 0};
+}
+
+struct Pattern {
+  const char * name;
+  bool (*apply)(vector<Instr> & out); // rewrites the tail of out if it matches
+  long hits;
+};
+Pattern patterns[] = {
+  // sw $s, -4($30); sub $30, $30, $4; add $30, $4, $30; lw $d, -4($30) => add $d, $s, $0
+  {"push-pop", [](vector<Instr> & out) {
+    int n = out.size();
+    if (n < 4) return false;
+    Instr * w = &out[n - 4];
+    if (!(w[0].op == SW && isMem(w[0], SW, w[0].t, -4, 30) && isReg(w[1], SUB, 30, 30, 4) &&
+          isReg(w[2], ADD, 30, 4, 30) && w[3].op == LW && isMem(w[3], LW, w[3].t, -4, 30))) return false;
+    Instr m = move(w[3].t, w[0].t);
+    out.resize(n - 4);
+    out.push_back(m);
+    return true;
+  }, 0},
+  // add $d, $d, $0 does nothing
+  {"self-move", [](vector<Instr> & out) {
+    Instr & i = out.back();
+    if (!(i.op == ADD && ((i.s == i.d && i.t == 0) || (i.t == i.d && i.s == 0)))) return false;
+    out.pop_back();
+    return true;
+  }, 0},
+  // lis $r; .word x; ... lis $r; .word x with $r unchanged in between
+  {"reload-constant", [](vector<Instr> & out) {
+    int n = out.size();
+    if (n < 4 || out[n - 2].op != LIS || out[n - 1].op != WORD) return false;
+    int r = out[n - 2].d;
+    for (int j = n - 3; j >= 1 && j >= n - WINDOW; --j) {
+      if (out[j].op == LABEL || out[j].op == IMPORT) return false;
+      if (out[j].op == WORD && out[j - 1].op == LIS && out[j - 1].d == r) {
+        if (!sameWord(out[j], out[n - 1])) return false;
+        out.resize(n - 2);
+        return true;
+      }
+      if (writes(out[j], r)) return false;
+    }
+    return false;
+  }, 0},
+  // beq/bne to a label that follows, possibly after other labels
+  {"branch-to-next", [](vector<Instr> & out) {
+    int n = out.size();
+    if (out.back().op != LABEL) return false;
+    for (int j = n - 2; j >= 0 && j >= n - WINDOW; --j) {
+      if ((out[j].op == BEQ || out[j].op == BNE) && out[j].isLabel && out[j].imm == out.back().imm) {
+        out.erase(out.begin() + j);
+        return true;
+      }
+      if (out[j].op != LABEL) return false;
+    }
+    return false;
+  }, 0},
+  // slt $3, ..; lis $5; .word 1; beq $3, $5, L => slt $3, ..; bne $3, $0, L
+  {"compare-one", [](vector<Instr> & out) {
+    int n = out.size();
+    if (n < 4) return false;
+    Instr * w = &out[n - 4];
+    if (!((w[0].op == SLT || w[0].op == SLTU) && w[1].op == LIS && w[1].d == 5 &&
+          w[2].op == WORD && !w[2].isLabel && w[2].imm == 1 &&
+          w[3].op == BEQ && w[3].s == w[0].d && w[3].t == 5)) return false;
+    Instr b = w[3];
+    b.op = BNE;
+    b.t = 0;
+    out.resize(n - 3);
+    out.push_back(b);
+    return true;
+  }, 0},
+  // lis $5; .word 0/4; add $30, $30, $5 pops nothing, or is add $30, $30, $4
+  {"flush-small", [](vector<Instr> & out) {
+    int n = out.size();
+    if (n < 3) return false;
+    Instr * w = &out[n - 3];
+    if (!(w[0].op == LIS && w[1].op == WORD && !w[1].isLabel && (w[1].imm == 0 || w[1].imm == 4) &&
+          isReg(w[2], ADD, 30, 30, w[0].d))) return false;
+    int bytes = w[1].imm;
+    out.resize(n - 3);
+    if (bytes == 4) out.push_back(Instr{ADD, 30, 30, 4, false, 0});
+    return true;
+  }, 0},
+  // sw $t, k($s); lw $u, k($s) => sw $t, k($s); add $u, $t, $0
+  {"store-load", [](vector<Instr> & out) {
+    int n = out.size();
+    if (n < 2) return false;
+    Instr * w = &out[n - 2];
+    if (!(w[0].op == SW && w[1].op == LW && w[0].s == w[1].s && w[0].imm == w[1].imm)) return false;
+    Instr m = move(w[1].t, w[0].t);
+    out.pop_back();
+    out.push_back(m);
+    return true;
+  }, 0},
+};
+
+void peephole(Emitter & e) {
+  vector<Instr> out;
+  for (auto & proc: e.procs) {
+    out.clear();
+    out.reserve(proc.size());
+    for (auto & i: proc) {
+      out.push_back(i);
+      for (bool changed = true; changed; ) {
+        changed = false;
+        for (auto & p: patterns) {
+          if (!out.empty() && p.apply(out)) {
+            ++p.hits;
+            changed = true;
+            break;
           }
         }
+      }
     }
-  } else if (aExpr->LH == "term") {
-    // cout << "term?" << endl;
-    if (n == 1) { // factor
-        aCode (aExpr->getChild("factor",1),varTable);
-    } else { // term () factor
-        // $5 <- term
-        // $3 <- factor
-        aCode (aExpr->getChild("term",1),varTable); 
-        push(3);
-        aCode(aExpr->getChild("factor",1), varTable);
-        pop(5);
-        if (aExpr->children[1]->LH == "STAR") {
-          Multu(5,3) ;
-          Mflo(3);
-        } else if (aExpr->children[1]->LH == "SLASH") {
-          Divu(5,3) ;
-          Mflo(3);
-        } else { // PCT
-          Divu(5,3) ;
-          Mfhi(3);
+    proc.swap(out);
+  }
+}
+
+// control flow over one procedure's instructions, once they are final.
+// Blocks start at labels and after beq, bne and jr; a call (jalr) returns, so
+// it stays inside its block. A branch out of the procedure (only the
+// prologue's beq to main) ends the flow like jr does. Every analysis is a
+// pass or a few over the blocks with fixed-size register sets, so the cost
+// grows with the procedure, not with its square
+const int HI = 32, LO = 33;
+typedef bitset<34> Regs; // $0..$31, hi and lo
+
+// registers the instruction reads and writes
+void effects(const Instr & i, Regs & use, Regs & def) {
+  use.reset();
+  def.reset();
+  switch (i.op) {
+    case ADD: case SUB: case SLT: case SLTU:
+      use[i.s] = use[i.t] = def[i.d] = true;
+      break;
+    case MULT: case MULTU: case DIV: case DIVU:
+      use[i.s] = use[i.t] = def[HI] = def[LO] = true;
+      break;
+    case MFHI: case MFLO:
+      use[i.op == MFHI ? HI : LO] = def[i.d] = true;
+      break;
+    case LIS:
+      def[i.d] = true;
+      break;
+    case LW:
+      use[i.s] = def[i.t] = true;
+      break;
+    case SW: case BEQ: case BNE:
+      use[i.s] = use[i.t] = true;
+      break;
+    case JR: // the caller sees the result, $4, the saved registers and the stack
+      use[i.s] = use[3] = use[4] = use[29] = use[30] = use[31] = true;
+      for (int r = 16; r <= 28; ++r) use[r] = true;
+      break;
+    case JALR: // arguments are on the stack, or in $1/$2 for the runtime
+      use[i.s] = use[1] = use[2] = use[4] = use[29] = use[30] = def[31] = true;
+      break;
+    default:
+      break;
+  }
+  use[0] = def[0] = false;
+}
+
+// immediate dominators by Cooper, Harvey and Kennedy's iteration over
+// reverse postorder (rpo[0] is the entry); -1 for the entry and for blocks
+// the entry doesn't reach
+vector<int> immediateDominators(const vector<vector<int>> & preds, const vector<int> & rpo) {
+  int nb = preds.size();
+  vector<int> order(nb, -1);
+  for (int i = 0; i < (int) rpo.size(); ++i) order[rpo[i]] = i;
+  vector<int> idom(nb, -1);
+  if (rpo.empty()) return idom;
+  idom[rpo[0]] = rpo[0];
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int i = 1; i < (int) rpo.size(); ++i) {
+      int k = rpo[i], d = -1;
+      for (int p: preds[k]) {
+        if (idom[p] < 0) continue;
+        if (d < 0) {
+          d = p;
+          continue;
         }
-    }
-  } else if (aExpr->LH == "factor") {
-    // cout << "factor?" << endl;
-    if (n == 1) { // ID or NUM
-      if (aExpr->children[0]->LH == "ID") {
-        Sw(3,varTable[(aExpr->getChild("ID",1)->RH[0])],29);
-      } else { // NUM
-        if (aExpr->type == "int") { // NUM
-          constant(3, stoll(aExpr->getChild("NUM",1)->RH[0]));
-        } else { // NULL = 1
-          constant(3,1);
+        int a = p, c = d;
+        while (a != c) {
+          while (order[a] > order[c]) a = idom[a];
+          while (order[c] > order[a]) c = idom[c];
         }
+        d = a;
       }
-    } else if (n == 2) { // AMP lvalue
-      Tree * lvalue = aExpr->getChild("lvalue",1) ;
-      if (lvalue->RH.size() == 1) { // lvalue -> ID
-        constant(3, varTable[aExpr->getChild("ID",1)->RH[0]]);
-        Add(3,29,3);
-      } else { // lvalue -> STAR factor
-        aCode(aExpr->getChild("factor",1),varTable) ;
-      }
-    } else if (n == 3) { 
-      if (aExpr->RH[0] == "ID") { // ID LPAREN RPAREN
-        push(29);
-        Call("P" + aExpr->getChild("ID",1)->RH[0]);
-        pop(29); // restore frame pointer
-      } else { // LPAREN expr RPAREN
-        aCode(aExpr->getChild("expr",1), varTable);
-      }
-    } else if (n == 5) { // NEW INT LBRACK expr RBRACK
-      aCode(aExpr->getChild("expr",1),varTable) ;
-      Add(1,3,0) ;
-      Call("new");
-      string newLabel = "label" + rand(); 
-      Bne(3,0,newLabel);
-      Lis(3);
-      Word(1);
-      Label(newLabel);
-    } else { // ID LPAREN arglist RPAREN
-      push(29); // save current frame pointer
-      Tree * arglst = aExpr->getChild("arglist", 1);
-      // evaluate arguments
-      while (true) {
-        aCode(arglst->getChild("expr", 1),varTable);
-        push(3);
-        if ((arglst->children).size() > 1) {
-          arglst = arglst->getChild("arglist",1);
-        } else {
-           break;
-        }
+      if (d != idom[k]) {
+        idom[k] = d;
+        changed = true;
       }
-      Call("P" + aExpr->getChild("ID",1)->RH[0]);
-      pop(29); // restore frame pointer
     }
-  } else if (aExpr->LH == "lvalue") {
-    // cout << "lvalue?" << endl;
-    if (n == 1) { // ID
-      Sw(3,varTable[aExpr->getChild("ID",1)->RH[0]],29);
-    } else if (n == 2) { // STAR FACTOR
-      aCode(aExpr->getChild("factor",1), varTable);
-      Lw(3,0,3);
-    } else { // LPAREN lvalue RPAREN
-      aCode(aExpr->getChild("lvalue",1), varTable) ;
+  }
+  idom[rpo[0]] = -1;
+  return idom;
+}
+// pre and post numbers of the tree idom describes, so a dominates b exactly
+// when pre[a] <= pre[b] and post[b] <= post[a]; -1 off the tree
+void numberDominatorTree(const vector<int> & idom, int root, vector<int> & pre, vector<int> & post) {
+  int nb = idom.size();
+  vector<vector<int>> kids(nb);
+  for (int k = 0; k < nb; ++k) {
+    if (idom[k] >= 0) kids[idom[k]].push_back(k);
+  }
+  pre.assign(nb, -1);
+  post.assign(nb, -1);
+  int counter = 0;
+  vector<pair<int, int>> stack;
+  if (nb) stack.push_back({root, 0});
+  while (!stack.empty()) {
+    int k = stack.back().first;
+    int & next = stack.back().second;
+    if (next == 0) pre[k] = counter++;
+    if (next < (int) kids[k].size()) {
+      stack.push_back({kids[k][next++], 0});
+    } else {
+      post[k] = counter++;
+      stack.pop_back();
     }
   }
 }
-void statements(Tree * stmtTree, map<string, int> & varTable, ProcedureTable & procTable) {
-  if (!((stmtTree->children).empty())) {
-    statements(stmtTree->getChild("statements",1), varTable, procTable);
-    Tree* stmt = stmtTree->getChild("statement",1);
-    int n = stmt->RH.size() ;
-    if (n == 4) { // lvalue BECOMES expr SEMI
-      Tree * lvalue = stmt->getChild("lvalue",1) ;
-      if (lvalue->RH.size() == 1) { // lvalue -> ID
-        aCode(lvalue->getChild("ID",1), varTable);
-        Sw(3,varTable[lvalue->getChild("ID",1)->RH[0]],29) ;
-      } else { // lvalue -> STAR factor
-        aCode(lvalue->getChild("factor",1),varTable) ;
-        push(3);
-        aCode(stmt->getChild("expr",1),varTable) ;
-        pop(5);
-        Sw(3,0,5);
+
+struct Block {
+  int first, last; // instructions [first, last)
+  vector<int> succs, preds;
+  Regs use, def;   // read before written in the block, written in it
+  Regs liveIn, liveOut;
+  vector<int> reachIn, reachOut; // definition ids, sorted
+  int idom = -1;   // -1 for the entry and for unreachable blocks
+  int pre = -1, post = -1; // dominator tree numbering
+};
+
+struct CFGStats {
+  long procs = 0, blocks = 0, edges = 0, instrs = 0, defs = 0;
+  double build = 0, live = 0, reach = 0, dom = 0; // seconds
+};
+CFGStats cfgStats;
+
+struct CFG {
+  const vector<Instr> * code = nullptr;
+  vector<Block> blocks;
+  vector<int> rpo;       // reverse postorder of the blocks reachable from the entry
+  vector<int> blockOf;   // by instruction
+  vector<int> defAt;     // by definition id: its instruction
+  vector<int> defReg;    // and the register it writes
+
+  void build(const vector<Instr> & instrs) {
+    auto start = chrono::steady_clock::now();
+    code = &instrs;
+    int n = instrs.size();
+    blockOf.assign(n, 0);
+    map<int, int> labelBlock;
+    for (int i = 0; i < n; ) {
+      Block b;
+      b.first = i;
+      while (i < n && instrs[i].op == LABEL) labelBlock[instrs[i++].imm] = blocks.size();
+      while (i < n && instrs[i].op != LABEL) {
+        Op op = instrs[i++].op;
+        if (op == BEQ || op == BNE || op == JR) break;
       }
-    } else if (n == 5) { 
-      if (stmt->RH[0] == "PRINTLN") { // PRINTLN LPAREN expr RPAREN SEMI
-        aCode(stmt->getChild("expr", 1), varTable) ; // sets expr in $3
-        Add(1,0,3);
-        Call("print");
-      } else { // DELETE LBRACK RBRACK expr SEMI
-        aCode(stmt->getChild("expr",1), varTable);
-        string newLabel = "label" + rand(); 
-        Lis(5);
-        Word(1);
-        Beq(3,5,newLabel); // if $3 = 1 then NULL so do nothing
-        Add(1,0,3);
-        Call("delete");
-        Label(newLabel);
+      b.last = i;
+      for (int j = b.first; j < b.last; ++j) blockOf[j] = blocks.size();
+      blocks.push_back(b);
+    }
+    int nb = blocks.size();
+    for (int k = 0; k < nb; ++k) {
+      Block & b = blocks[k];
+      const Instr * end = b.last > b.first ? &instrs[b.last - 1] : nullptr;
+      bool falls = !end || end->op != JR;
+      if (end && (end->op == BEQ || end->op == BNE) && end->isLabel) {
+        auto it = labelBlock.find(end->imm);
+        if (it != labelBlock.end()) b.succs.push_back(it->second);
+        if (end->op == BEQ && end->s == end->t) falls = false; // beq $0, $0
       }
-    } else { // WHILE or IF
-      bool isIF = (stmt->children[0]->LH == "IF");
-      string jumpTo = "label" + rand(); 
-      string whileLabel = "while"+ rand();
-      if (!isIF) { //
-        Label(whileLabel);
+      if (falls && k + 1 < nb && (b.succs.empty() || b.succs[0] != k + 1)) b.succs.push_back(k + 1);
+      for (int s: b.succs) blocks[s].preds.push_back(k);
+      cfgStats.edges += b.succs.size();
+      Regs use, def;
+      for (int j = b.first; j < b.last; ++j) {
+        effects(instrs[j], use, def);
+        b.use |= use & ~b.def;
+        b.def |= def;
+        for (int r = 0; r < 34; ++r) {
+          if (def[r]) {
+            defAt.push_back(j);
+            defReg.push_back(r);
+          }
+        }
       }
-      // test expr1 [] expr2 : $5 <- expr1, $3<- expr2
-      Tree * test = stmt->getChild("test",1);
-      string op = test->RH[1];
-      aCode(test->getChild("expr",1),varTable);
-      push(3);
-      aCode(test->getChild("expr",2),varTable);
+    }
+    // depth-first from the entry with an explicit stack
+    vector<int> post;
+    vector<bool> seen(nb, false);
+    vector<pair<int, int>> stack;
+    if (nb) {
+      stack.push_back({0, 0});
+      seen[0] = true;
+    }
+    while (!stack.empty()) {
+      int k = stack.back().first;
+      int & next = stack.back().second;
+      if (next < (int) blocks[k].succs.size()) {
+        int s = blocks[k].succs[next++];
+        if (!seen[s]) {
+          seen[s] = true;
+          stack.push_back({s, 0});
+        }
+      } else {
+        post.push_back(k);
+        stack.pop_back();
+      }
+    }
+    rpo.assign(post.rbegin(), post.rend());
+    ++cfgStats.procs;
+    cfgStats.blocks += nb;
+    cfgStats.instrs += n;
+    cfgStats.defs += defAt.size();
+    cfgStats.build += secondsSince(start);
+  }
+
+  // live registers at block boundaries, backwards to a fixed point
+  void liveness() {
+    auto start = chrono::steady_clock::now();
+    for (bool changed = true; changed; ) {
+      changed = false;
+      for (int k = rpo.size() - 1; k >= 0; --k) {
+        Block & b = blocks[rpo[k]];
+        Regs out;
+        for (int s: b.succs) out |= blocks[s].liveIn;
+        Regs in = b.use | (out & ~b.def);
+        if (in != b.liveIn || out != b.liveOut) changed = true;
+        b.liveIn = in;
+        b.liveOut = out;
+      }
+    }
+    cfgStats.live += secondsSince(start);
+  }
+  // registers live just after instruction i
+  Regs liveAfter(int i) {
+    Block & b = blocks[blockOf[i]];
+    Regs live = b.liveOut, use, def;
+    for (int j = b.last - 1; j > i; --j) {
+      effects((*code)[j], use, def);
+      live = (live & ~def) | use;
+    }
+    return live;
+  }
+
+  // definitions reaching each block. A block passes on what reaches it less
+  // the registers it writes, plus its own last write of each; the sets hold
+  // about one definition per register per path merging in, so stay small
+  void reachingDefs() {
+    auto start = chrono::steady_clock::now();
+    // each block's last definition of each register, found walking backwards
+    vector<vector<int>> gen(blocks.size());
+    Regs seen;
+    for (int id = defAt.size() - 1, k = -1; id >= 0; --id) {
+      if (blockOf[defAt[id]] != k) {
+        k = blockOf[defAt[id]];
+        seen.reset();
+      }
+      if (!seen[defReg[id]]) gen[k].push_back(id);
+      seen[defReg[id]] = true;
+    }
+    for (auto & g: gen) reverse(g.begin(), g.end());
+    for (bool changed = true; changed; ) {
+      changed = false;
+      for (int k: rpo) {
+        Block & b = blocks[k];
+        vector<int> in;
+        for (int p: b.preds) {
+          vector<int> merged;
+          set_union(in.begin(), in.end(), blocks[p].reachOut.begin(), blocks[p].reachOut.end(), back_inserter(merged));
+          in.swap(merged);
+        }
+        vector<int> out;
+        for (int id: in) {
+          if (!b.def[defReg[id]]) out.push_back(id);
+        }
+        vector<int> merged;
+        set_union(out.begin(), out.end(), gen[k].begin(), gen[k].end(), back_inserter(merged));
+        if (merged != b.reachOut) changed = true;
+        b.reachIn.swap(in);
+        b.reachOut.swap(merged);
+      }
+    }
+    cfgStats.reach += secondsSince(start);
+  }
+
+  void dominators() {
+    auto start = chrono::steady_clock::now();
+    vector<vector<int>> preds;
+    for (auto & b: blocks) preds.push_back(b.preds);
+    vector<int> idom = immediateDominators(preds, rpo), pre, post;
+    numberDominatorTree(idom, 0, pre, post);
+    for (int k = 0; k < (int) blocks.size(); ++k) {
+      blocks[k].idom = idom[k];
+      blocks[k].pre = pre[k];
+      blocks[k].post = post[k];
+    }
+    cfgStats.dom += secondsSince(start);
+  }
+  bool dominates(int a, int b) {
+    return blocks[b].pre >= 0 && blocks[a].pre <= blocks[b].pre && blocks[b].post <= blocks[a].post;
+  }
+
+  // one cluster per procedure: instructions and live-in registers in each
+  // block, flow edges solid and dominator tree edges dashed
+  void dot(ostream & out, Emitter & e, int proc) {
+    out << "  subgraph cluster" << proc << " {\n";
+    for (int k = 0; k < (int) blocks.size(); ++k) {
+      Block & b = blocks[k];
+      string text;
+      for (int j = b.first; j < b.last; ++j) {
+        e.appendInstr(text, (*code)[j]);
+        text += "\\l";
+      }
+      out << "    p" << proc << "b" << k << " [shape=box, label=\"B" << k << "  live in:";
+      for (int r = 0; r < 34; ++r) {
+        if (b.liveIn[r]) out << (r == HI ? " hi" : r == LO ? " lo" : " $" + to_string(r));
+      }
+      out << "\\l" << text << "\"];\n";
+      for (int s: b.succs) out << "    p" << proc << "b" << k << " -> p" << proc << "b" << s << ";\n";
+      if (b.idom >= 0) {
+        out << "    p" << proc << "b" << b.idom << " -> p" << proc << "b" << k << " [style=dashed, color=gray];\n";
+      }
+    }
+    out << "  }\n";
+  }
+};
+
+// builds and analyses every procedure's graph, for --stats and --cfg-dot
+void analyseCFGs(Emitter & e, ostream * dotOut) {
+  if (dotOut) *dotOut << "digraph cfg {\n";
+  for (int p = 0; p < (int) e.procs.size(); ++p) {
+    CFG g;
+    g.build(e.procs[p]);
+    g.liveness();
+    g.reachingDefs();
+    g.dominators();
+    if (dotOut) g.dot(*dotOut, e, p);
+  }
+  if (dotOut) *dotOut << "}\n";
+}
+
+// expression temporaries live in $6..$15. Their lifetimes nest with the tree
+// walk, so a linear scan over them is just: take the lowest free register when
+// a value is defined and free it at its one use. With none free the value is
+// spilled to the stack as before.
+const int FIRST_TEMP = 6;
+const int LAST_TEMP = 15;
+struct Temps {
+  bitset<32> used; // allocated to some value
+  bitset<32> live; // value computed and still needed
+  bitset<32> vars; // standing in for a variable of an inlined procedure
+  int peak = 0;
+  long spills = 0;
+  long saves = 0; // live temporaries saved around calls
+  int alloc() { // returns -1 when all are taken
+    for (int r = FIRST_TEMP; r <= LAST_TEMP; ++r) {
+      if (!used[r]) {
+        used[r] = true;
+        if ((int) used.count() > peak) peak = used.count();
+        return r;
+      }
+    }
+    ++spills;
+    return -1;
+  }
+  void define(int r) {
+    live[r] = true;
+  }
+  void release(int r) {
+    used[r] = false;
+    live[r] = false;
+    vars[r] = false;
+  }
+};
+Temps temps;
+// a callee may use any temporary, so live ones go on the stack across a call.
+// The runtime routines preserve everything but $3 and need no saving
+vector<int> saveLive() {
+  vector<int> saved;
+  for (int r = FIRST_TEMP; r <= LAST_TEMP; ++r) {
+    if (temps.live[r]) {
+      push(r);
+      saved.push_back(r);
+    }
+  }
+  temps.saves += saved.size();
+  return saved;
+}
+void restoreLive(const vector<int> & saved) {
+  for (int i = saved.size() - 1; i >= 0; --i) {
+    pop(saved[i]);
+  }
+}
+// from -O1 the first arguments of a procedure call go in temporaries, which
+// a call may change anyway, and only the rest are pushed. The runtime still
+// takes its argument in $1
+const int ARG_REGS[] = {6, 7, 8, 9};
+const int REG_ARGS = 4;
+bool regArgs = false;
+long argsInRegs = 0;
+long argsPushed = 0;
+// the register parameter slot of a procedure with params parameters
+// arrives in, or 0 if it was pushed. Slots count down from the first
+int argReg(int slot, int params) {
+  int k = params - slot;
+  return regArgs && slot > 0 && k < REG_ARGS ? ARG_REGS[k] : 0;
+}
+// copies each pair's second register to its first as if all at once,
+// parking a value in $5 to break a cycle
+void parallelMove(vector<pair<int, int>> moves) {
+  while (!moves.empty()) {
+    int i = 0, n = moves.size();
+    for (; i < n; ++i) {
+      bool read = false;
+      for (int j = 0; j < n && !read; ++j) read = j != i && moves[j].second == moves[i].first;
+      if (!read) break;
+    }
+    if (i < n) {
+      if (moves[i].first != moves[i].second) Add(moves[i].first, moves[i].second, 0);
+      moves.erase(moves.begin() + i);
+      continue;
+    }
+    int cycle = moves[0].first;
+    Add(5, cycle, 0);
+    for (auto & m: moves) {
+      if (m.second == cycle) m.second = 5;
+    }
+  }
+}
+
+// the ID expr is only a use of, through single children, parentheses and
+// whatever fold simplified away
+Tree * useOf(Tree * expr) {
+  while (true) {
+    while (expr->same) expr = expr->same;
+    if (expr->isConst || expr->children.empty()) return nullptr;
+    if (expr->RH.size() == 3 && expr->RH[0] == "LPAREN") {
+      expr = expr->children[1];
+    } else if (expr->RH.size() == 1) {
+      if (expr->children[0]->LH == "ID") return expr->children[0];
+      expr = expr->children[0];
+    } else {
+      return nullptr;
+    }
+  }
+}
+
+// folds constant int subexpressions (32-bit wraparound, signed mult/div like
+// the generated code) and simplifies +0, *1, *0, %1 and x-x. Needs types, so
+// it runs between checking and codegen; nothing is removed that could call
+struct Folder {
+  long folded = 0;
+  // the node fold settled on for n
+  Tree * target(Tree * n) {
+    while (n->same) n = n->same;
+    return n;
+  }
+  bool isConst(Tree * n, int v) {
+    n = target(n);
+    return n->isConst && n->value == v;
+  }
+  bool pure(Tree * n) { // no procedure call or new
+    if (n->LH == "factor" && (n->RH[0] == "NEW" || (n->RH[0] == "ID" && n->RH.size() > 1))) return false;
+    for (auto c: n->children) {
+      if (!pure(c)) return false;
+    }
+    return true;
+  }
+  void setConst(Tree * n, int v) {
+    n->isConst = true;
+    n->value = v;
+    ++folded;
+  }
+  void setSame(Tree * n, Tree * to) {
+    n->same = to;
+    ++folded;
+  }
+  void fold(Tree * n) {
+    for (auto c: n->children) {
+      fold(c);
+    }
+    if (n->LH == "factor") {
+      if (n->RH[0] == "NUM") {
+        n->isConst = true;
+        n->value = stoll(n->children[0]->RH[0]);
+      } else if (n->RH[0] == "LPAREN") {
+        n->same = n->children[1];
+      }
+      return;
+    }
+    if (n->LH != "expr" && n->LH != "term") return;
+    if (n->RH.size() == 1) {
+      n->same = n->children[0];
+      return;
+    }
+    Tree * l = target(n->children[0]);
+    Tree * r = target(n->children[2]);
+    string op = n->RH[1];
+    unsigned a = l->value, b = r->value;
+    if (l->isConst && r->isConst) { // both int
+      if (op == "PLUS") return setConst(n, a + b);
+      if (op == "MINUS") return setConst(n, a - b);
+      if (op == "STAR") return setConst(n, a * b);
+      if (b != 0 && !(a == 0x80000000 && b == 0xffffffff)) {
+        if (op == "SLASH") return setConst(n, l->value / r->value);
+        return setConst(n, l->value % r->value);
+      }
+      return;
+    }
+    if (op == "PLUS") {
+      if (isConst(r, 0)) return setSame(n, l); // scaled or not, 0 adds nothing
+      if (isConst(l, 0)) return setSame(n, r);
+    } else if (op == "MINUS") {
+      if (isConst(r, 0)) return setSame(n, l);
+      Tree * x = useOf(l);
+      Tree * y = useOf(r);
+      if (x && y && x->RH[0] == y->RH[0]) return setConst(n, 0);
+    } else if (op == "STAR") {
+      if (isConst(r, 1)) return setSame(n, l);
+      if (isConst(l, 1)) return setSame(n, r);
+      if ((isConst(r, 0) && pure(l)) || (isConst(l, 0) && pure(r))) return setConst(n, 0);
+    } else if (op == "SLASH") {
+      if (isConst(r, 1)) return setSame(n, l);
+    } else { // PCT
+      if (isConst(r, 1) && pure(l)) return setConst(n, 0);
+    }
+  }
+};
+
+Folder folder;
+
+// in fused mode (vars != nullptr) each node is typed right after the code for
+// its children is emitted, so the tree is walked once instead of twice. Code
+// can't be generated past a type error, so fused mode stops at the first one
+Diagnostics fusedDiags;
+void typeNode(Tree * node, VariableTable * vars, ProcedureTable & procTable) {
+  if (vars) annoteNode(node, *vars, procTable, fusedDiags);
+}
+
+// the ID an lvalue names through any parentheses, or nullptr for STAR factor
+Tree * lvalueID(Tree * lvalue) {
+  while (lvalue->RH.size() == 3) { // LPAREN lvalue RPAREN
+    lvalue = lvalue->getChild("lvalue",1);
+  }
+  return lvalue->RH.size() == 1 ? lvalue->getChild("ID",1) : nullptr;
+}
+
+// variables whose address is never taken live in the callee-saved registers
+// $16..$28 for the whole procedure, heaviest use (weighted by WHILE nesting)
+// first. The rest, and any that don't fit, keep a stack slot
+const int FIRST_SAVED = 16;
+const int LAST_SAVED = 28;
+struct Frame {
+  int lowest = 0; // slot of the last local
+  vector<int> reg; // by slot - lowest, 0 for a variable on the stack
+  vector<int> offset; // by slot - lowest, from $29, for stack variables
+  vector<int> saved; // callee-saved registers used, stored below $29
+  vector<bool> unread; // by slot - lowest, variables nothing reads, which get no home
+  int links = 0; // words below $29 before the saved registers
+  bool leaf = false; // calls nothing, not even the runtime
+  bool frameless = false; // a leaf with every variable in a register never sets $29
+  int fp = 29, bias = 0; // the frame is addressed from $fp, bias above $29
+  int stackLocals = 0;
+  vector<bool> taken; // by slot - lowest, variables named under &
+  bool anyTaken = false;
+  int home(int slot) {
+    return reg[slot - lowest];
+  }
+  bool isUnread(int slot) {
+    return !unread.empty() && unread[slot - lowest];
+  }
+  int at(int slot) {
+    return offset[slot - lowest];
+  }
+  bool isTaken(int slot) {
+    return taken[slot - lowest];
+  }
+};
+Frame frame;
+long promotedVars = 0;
+long stackVars = 0;
+long unreadVars = 0;
+// variables only ever assigned to are not kept: their assignments evaluate
+// just the calls in the expression. Not in fused mode, which checks as it goes
+bool dropUnread = false;
+
+// by slot - frame.lowest. Fused mode plans the frame before the body is
+// checked, so each use is resolved here and the slot left on its ID for need()
+void countUses(Tree * node, int depth, vector<long> & weight, VariableTable & vars) {
+  if (node->LH == "ID") {
+    Variable * var = vars.Find(node->RH[0]);
+    if (var) {
+      node->slot = var->slot;
+      weight[var->slot - frame.lowest] += 1L << min(3 * depth, 40);
+    }
+    return;
+  }
+  if (node->LH == "factor" && node->RH[0] == "AMP") {
+    Tree * id = lvalueID(node->getChild("lvalue",1));
+    Variable * var = id ? vars.Find(id->RH[0]) : nullptr;
+    if (var) frame.taken[var->slot - frame.lowest] = frame.anyTaken = true;
+  }
+  if (node->LH == "statement" && node->RH[0] == "WHILE") ++depth;
+  for (auto c: node->children) {
+    countUses(c, depth, weight, vars);
+  }
+}
+// names read anywhere in node: every ID but an assignment's target
+void countReads(Tree * node, map<string,bool> & read) {
+  if (node->LH == "ID") {
+    read[node->RH[0]] = true;
+    return;
+  }
+  if (node->LH == "statement" && node->RH.size() == 4 && lvalueID(node->getChild("lvalue",1))) {
+    countReads(node->getChild("expr",1), read);
+    return;
+  }
+  for (auto c: node->children) {
+    countReads(c, read);
+  }
+}
+// true if evaluating node calls a procedure or allocates, or with runtime
+// if it calls anything at all
+bool hasCalls(Tree * node, bool runtime = false) {
+  if (node->LH == "NEW" || (node->LH == "factor" && node->RH.size() >= 3 && node->RH[0] == "ID")) return true;
+  if (runtime && (node->LH == "PRINTLN" || node->LH == "DELETE")) return true;
+  for (auto c: node->children) {
+    if (hasCalls(c, runtime)) return true;
+  }
+  return false;
+}
+// decides where each variable of proc lives; wain has no caller to save for
+void planFrame(Tree * procTree, Procedure & proc, bool calleeSaves) {
+  frame = Frame();
+  frame.lowest = -proc.locals;
+  frame.reg.assign(proc.locals + proc.signature.size() + 1, 0);
+  frame.taken.assign(frame.reg.size(), false);
+  vector<long> weight(frame.reg.size(), 0);
+  countUses(procTree->getChild("statements",1), 0, weight, proc.symTable);
+  countUses(procTree->getChild("expr",1), 0, weight, proc.symTable);
+  frame.offset.assign(frame.reg.size(), 0);
+  map<string,bool> read;
+  if (dropUnread) {
+    countReads(procTree->getChild("statements",1), read);
+    countReads(procTree->getChild("expr",1), read);
+    frame.unread.assign(frame.reg.size(), false);
+  }
+  vector<Variable*> candidates;
+  int unread = 0;
+  for (auto & v: proc.symTable.varTable) {
+    Variable & var = v.second;
+    frame.offset[var.slot - frame.lowest] = var.slot * 4;
+    bool taken = frame.isTaken(var.slot);
+    if (dropUnread && !taken && !read[var.name]) {
+      frame.unread[var.slot - frame.lowest] = true;
+      ++unread;
+    } else if (!taken && weight[var.slot - frame.lowest] > 0) {
+      candidates.push_back(&var);
+    }
+  }
+  stable_sort(candidates.begin(), candidates.end(), [&](Variable * a, Variable * b) {
+    return weight[a->slot - frame.lowest] > weight[b->slot - frame.lowest];
+  });
+  int next = FIRST_SAVED;
+  for (auto var: candidates) {
+    if (next > LAST_SAVED) break;
+    frame.reg[var->slot - frame.lowest] = next;
+    if (calleeSaves) frame.saved.push_back(next);
+    ++next;
+  }
+  if (calleeLinks) {
+    frame.leaf = calleeSaves && !hasCalls(procTree->getChild("statements",1), true) &&
+                 !hasCalls(procTree->getChild("expr",1), true);
+    frame.frameless = frame.leaf;
+    for (auto & v: proc.symTable.varTable) {
+      int slot = v.second.slot;
+      if (!frame.home(slot) && !frame.isUnread(slot)) frame.frameless = false;
+    }
+    frame.links = frame.frameless ? -1 : 1;
+    leafProcs += frame.leaf;
+    framelessProcs += frame.frameless;
+    if (frame.frameless) {
+      frame.fp = 30;
+      frame.bias = 4 * frame.saved.size() - 4;
+    }
+  }
+  // stack locals are packed below the saved registers in declaration order,
+  // then the parameters that came in registers and need a word
+  int params = calleeSaves ? proc.signature.size() : 0;
+  vector<int> slots;
+  for (int slot = -1; slot >= frame.lowest; --slot) slots.push_back(slot);
+  for (int slot = params; argReg(slot, params); --slot) slots.push_back(slot);
+  for (int slot: slots) {
+    if (!frame.home(slot) && !frame.isUnread(slot)) {
+      ++frame.stackLocals;
+      frame.offset[slot - frame.lowest] = -4 * (int) (frame.links + frame.saved.size() + frame.stackLocals);
+    }
+  }
+  promotedVars += next - FIRST_SAVED;
+  stackVars += proc.symTable.varTable.size() - (next - FIRST_SAVED) - unread;
+  unreadVars += unread;
+}
+
+void declarations(Tree* dcls) { // initializes locals in order, slots -1, -2, ...
+  if (!((dcls->children).empty())) {
+    declarations(dcls->getChild("dcls",1)) ;
+    int slot = dcls->getChild("dcl",1)->getChild("ID",1)->slot;
+    if (frame.isUnread(slot)) return;
+    int r = frame.home(slot);
+    if (dcls->RH[3] == "NULL") { // NULL = 1
+      constant(r ? r : 5,1);
+    } else {
+      constant(r ? r : 5,stoll(dcls->getChild("NUM",1)->RH[0]));
+    }
+    if (!r && calleeLinks) {
+      Sw(5,frame.at(slot),29);
+    } else if (!r) {
+      push(5);
+    }
+  }
+}
+// the register of the promoted variable expr reads, or 0
+int varReg(Tree * expr, ProcedureTable & procTable, VariableTable * vars) {
+  Tree * id = useOf(expr);
+  if (!id) return 0;
+  if (vars) annoteTypes(expr, *vars, procTable, fusedDiags);
+  return frame.home(id->slot);
+}
+void aCode(Tree * aExpr, int dest, ProcedureTable & procTable, VariableTable * vars);
+// types the lvalue nodes above an already typed STAR factor
+void typeLvalue(Tree * lvalue, VariableTable * vars, ProcedureTable & procTable) {
+  if (lvalue->RH.size() == 3) typeLvalue(lvalue->getChild("lvalue",1), vars, procTable);
+  typeNode(lvalue, vars, procTable);
+}
+void lvalueCode(Tree * lvalue, int dest, ProcedureTable & procTable, VariableTable * vars) { // address of lvalue in $dest
+  int n = lvalue->RH.size();
+  if (n == 1) { // ID
+    typeNode(lvalue, vars, procTable);
+    constant(dest, frame.at(lvalue->getChild("ID",1)->slot));
+    Add(dest,29,dest);
+    return;
+  } else if (n == 2) { // STAR factor
+    aCode(lvalue->getChild("factor",1), dest, procTable, vars);
+  } else { // LPAREN lvalue RPAREN
+    lvalueCode(lvalue->getChild("lvalue",1), dest, procTable, vars);
+  }
+  typeNode(lvalue, vars, procTable);
+}
+// Sethi-Ullman labelling, cached on the node. A call saves every live
+// temporary around itself, so it counts as needing all of them
+const int CALL_NEED = LAST_TEMP - FIRST_TEMP + 2;
+int need(Tree * n) {
+  if (n->need >= 0) return n->need;
+  Tree * t = n;
+  while (t->same) t = t->same;
+  int k = 1;
+  if (t->isConst) {
+    k = 1;
+  } else if (t->LH != "factor" && t->RH.size() == 1) { // expr -> term, term -> factor
+    k = need(t->children[0]);
+    t->calls = t->children[0]->calls;
+    t->reads = t->children[0]->reads;
+  } else if (t->LH != "factor") { // binary
+    Tree * a = t->children[0];
+    Tree * b = t->children[2];
+    int na = need(a), nb = need(b);
+    k = min(na == nb ? na + 1 : max(na, nb), CALL_NEED);
+    t->calls = a->calls || b->calls;
+    t->reads = a->reads || b->reads;
+  } else if (t->RH[0] == "ID" && t->RH.size() == 1) {
+    t->reads = frame.isTaken(t->children[0]->slot);
+  } else if (t->RH[0] == "LPAREN") {
+    k = need(t->children[1]);
+    t->calls = t->children[1]->calls;
+    t->reads = t->children[1]->reads;
+  } else if (t->RH[0] == "STAR") {
+    k = need(t->children[1]);
+    t->calls = t->children[1]->calls;
+    t->reads = true;
+  } else if (t->RH[0] == "AMP") {
+    Tree * id = lvalueID(t->children[1]);
+    if (!id) { // &*factor through parentheses
+      Tree * lvalue = t->children[1];
+      while (lvalue->RH.size() == 3) lvalue = lvalue->children[1];
+      Tree * f = lvalue->children[1];
+      k = need(f);
+      t->calls = f->calls;
+      t->reads = f->reads;
+    }
+  } else if (t->RH[0] == "NEW" || t->RH[0] == "ID") { // new or a call
+    k = CALL_NEED;
+    t->calls = true;
+  }
+  n->need = t->need = k;
+  n->calls = t->calls;
+  n->reads = t->reads;
+  return k;
+}
+// where operands() left the two sides, and the temporaries it took (or 0)
+struct Operands {
+  int l, r;
+  int held[2];
+};
+// a temporary free to hold an intermediate value
+bool isTemp(int r) {
+  return r >= FIRST_TEMP && r <= LAST_TEMP && !temps.vars[r];
+}
+// evaluates both sides, the one needing more registers first when swapping
+// can't change what either sees, i.e. unless one calls and the other calls or
+// reads memory. The first side goes into $dest when that is a temporary, so a
+// chain of heavier sides reuses one register; the second gets a temporary of
+// its own. Variables are read in place. Without a free temporary the
+// first side is spilled and ends up in $5
+bool orderByNeed = true;
+Operands operands(Tree * lhs, Tree * rhs, int dest, ProcedureTable & procTable, VariableTable * vars) {
+  bool swap = orderByNeed && need(rhs) > need(lhs) && !(rhs->calls && (lhs->calls || lhs->reads)) &&
+              !(lhs->calls && rhs->reads);
+  Tree * first = swap ? rhs : lhs;
+  Tree * second = swap ? lhs : rhs;
+  Operands o{0, 0, {0, 0}};
+  int f = varReg(first, procTable, vars);
+  bool writable = !f;
+  if (!f) {
+    f = isTemp(dest) ? dest : (o.held[0] = temps.alloc());
+    if (f < 0) {
+      f = 3;
+      o.held[0] = 0;
+    }
+    aCode(first, f, procTable, vars);
+    if (f != 3) temps.define(f);
+  }
+  int s = varReg(second, procTable, vars);
+  if (!s) {
+    s = (f == 3) ? -1 : temps.alloc();
+    if (s < 0) {
+      push(f);
+      // $dest is only written once second is done with it
+      aCode(second, s = writable ? f : dest, procTable, vars);
       pop(5);
-      // if true DON'T jump otherwise jump
-      if (op == "EQ") {
-        Bne(3,5,jumpTo); // jump to else
-      } else if (op == "NE") {
-        Beq(3,5,jumpTo);
-      } else if (op == "LT") {
-        Sltu(3,5,3); // expr1 < expr2
-        Beq(3,0,jumpTo);
-      } else if (op == "LE") {
-        Sltu(3,3,5); // expr2 < exp1 == !(exp1 <= expr2)
-        constant(5,1);
-        Beq(3,5,jumpTo);
-      } else if (op == "GE") {
-        Sltu(3,5,3); // expr2 < exp1 == !(exp1 <= expr2)
-        constant(5,1);
-        Beq(3,5,jumpTo);
-      } else { // GT
-        Sltu(3,3,5); // expr2 < expr1
-        Beq(3,0,jumpTo);
+      f = 5;
+    } else {
+      o.held[1] = s;
+      aCode(second, s, procTable, vars);
+    }
+  }
+  o.l = swap ? s : f;
+  o.r = swap ? f : s;
+  return o;
+}
+// pointer arithmetic scales by two adds rather than a mult, and pointer
+// differences divide by a multiply rather than a div, which take many cycles
+bool addScale = false;
+long scaled = 0;
+// multiplies $x by 4 into a register neither side is in, so a promoted
+// variable is never changed; returns where the result went
+int scaleBy4(int x, const Operands & o, int dest) {
+  int to = (dest != o.l && dest != o.r) ? dest : (o.l != 3 && o.r != 3) ? 3 : 5;
+  if (addScale) {
+    Add(to,x,x);
+    Add(to,to,to);
+    ++scaled;
+  } else {
+    Mult(x,4);
+    Mflo(to);
+  }
+  return to;
+}
+void doneWith(const Operands & o) {
+  for (int h: o.held) {
+    if (h > 0) temps.release(h);
+  }
+}
+// who calls whom, from the checked tree. Procedures are declared before they
+// are used, so the only cycles are procedures calling themselves
+// procedures wain cannot reach in the call graph are generated like the rest,
+// so fused mode still checks them, and their blocks dropped afterwards
+struct Stripper {
+  bool enabled = false;
+  long procs = 0; // procedures dropped
+  long bytes = 0; // of code they had
+  void unreachable(CallGraph & graph, Emitter & e, vector<int> & gone) {
+    for (int p = 0; p < (int) graph.names.size(); ++p) {
+      int b = procBlock[graph.names[p]];
+      if (graph.reachable[p] || find(gone.begin(), gone.end(), b) != gone.end()) continue;
+      ++procs;
+      bytes += e.bytes(b);
+      gone.push_back(b);
+    }
+  }
+};
+Stripper stripper;
+
+// leaf procedures with short bodies are expanded where they are called: the
+// arguments are evaluated into temporaries that stand in for the parameters,
+// the locals get temporaries of their own, and the body is generated in place
+// with those as its frame. Bodies no call is left to are dropped afterwards
+const int INLINE_BUDGET = 40; // tokens in the declarations, statements and return
+struct Inliner {
+  struct Candidate {
+    Tree * tree;
+    map<int,bool> assigned; // slots of variables the body assigns to
+  };
+  bool enabled = false;
+  map<string, Candidate> candidates;
+  map<string, long> outOfLine; // calls still made with Call
+  map<string, long> expanded;
+  long declined = 0;           // candidate calls with too few free temporaries
+  long dropped = 0;            // instructions in bodies that were dropped
+
+  static int tokens(Tree * t, bool & amp) {
+    if (t->children.empty()) {
+      if (t->LH == "AMP") amp = true;
+      return !t->RH.empty();
+    }
+    int n = 0;
+    for (auto c: t->children) n += tokens(c, amp);
+    return n;
+  }
+  static void collectAssigned(Tree * t, map<int,bool> & assigned) {
+    if (t->LH == "statement" && t->RH.size() == 4) {
+      Tree * id = lvalueID(t->getChild("lvalue",1));
+      if (id) assigned[id->slot] = true;
+    }
+    for (auto c: t->children) collectAssigned(c, assigned);
+  }
+  void plan(CallGraph & graph, vector<Tree*> & trees) {
+    enabled = true;
+    for (int p = 0; p < (int) graph.names.size(); ++p) {
+      Tree * proc = trees[p];
+      if (proc->LH == "main" || !graph.leaf[p] || graph.recursive[p]) continue;
+      // address-taken variables need a stack slot, which an expansion has not got
+      bool amp = false;
+      int size = tokens(proc->getChild("dcls",1), amp) + tokens(proc->getChild("statements",1), amp) +
+                 tokens(proc->getChild("expr",1), amp);
+      if (amp || size > INLINE_BUDGET) continue;
+      Candidate & c = candidates[graph.names[p]];
+      c.tree = proc;
+      collectAssigned(proc->getChild("statements",1), c.assigned);
+    }
+  }
+  // the blocks of the procedures every call was expanded at
+  void prune(Emitter & e, vector<int> & gone) {
+    for (auto & c: candidates) {
+      if (expanded.count(c.first) && !outOfLine.count(c.first)) {
+        int b = procBlock[c.first];
+        dropped += e.procs[b].size();
+        gone.push_back(b);
+      }
+    }
+  }
+};
+Inliner inliner;
+bool inlineCall(Tree * call, int dest, ProcedureTable & procTable, VariableTable * vars);
+
+void aCode(Tree * aExpr, int dest, ProcedureTable & procTable, VariableTable * vars) { // evaluates expr into $dest
+  // accepts expr, factor, term. $dest is only written once every subexpression
+  // (and so every call) is done, so it can be any register the caller likes
+  while (aExpr->same) aExpr = aExpr->same;
+  if (aExpr->isConst) {
+    constant(dest, aExpr->value);
+    return;
+  }
+  int n = aExpr->RH.size();
+  
+  if (aExpr->LH == "expr") {
+    if (aExpr->RH.size() == 1) { // -> term
+        aCode(aExpr->getChild("term",1),dest,procTable,vars) ;
+    } else { // -> expr PLUS/MINUS term
+        // $l <- expr
+        // $r <- term
+        Operands o = operands(aExpr->getChild("expr",1), aExpr->getChild("term",1), dest, procTable, vars);
+        int l = o.l, r = o.r;
+        if (aExpr->children[1]->LH == "PLUS") { //PLUS   
+          if (aExpr->getChild("expr",1)->type == "int*") { // int* + int
+            r = scaleBy4(r, o, dest);
+          } 
+          if (aExpr->getChild("term",1)->type == "int*") { // int + int*
+            l = scaleBy4(l, o, dest);
+          }
+          Add(dest,l,r);
+        } else { // MINUS
+          if (aExpr->getChild("term",1)->type == "int") { // int(*) - int
+            if (aExpr->getChild("expr",1)->type == "int*") {
+              r = scaleBy4(r, o, dest);
+            }
+            Sub(dest,l,r);
+          } else {
+            Sub(dest,l,r);
+            if (addScale) { // a multiple of 4, so the high word of it times 2^30 is exact
+              int k = dest != 5 ? 5 : 3;
+              ++scaled;
+              Lis(k);
+              Word(0x40000000);
+              Mult(dest,k);
+              Mfhi(dest);
+            } else {
+              Div(dest,4);
+              Mflo(dest);
+            }
+          }
+        }
+        doneWith(o);
+    }
+  } else if (aExpr->LH == "term") {
+    if (n == 1) { // factor
+        aCode (aExpr->getChild("factor",1),dest,procTable,vars);
+    } else { // term () factor
+        // $l <- term
+        // $r <- factor
+        Operands o = operands(aExpr->getChild("term",1), aExpr->getChild("factor",1), dest, procTable, vars);
+        int l = o.l, r = o.r;
+        if (aExpr->children[1]->LH == "STAR") {
+          Mult(l,r) ;
+          Mflo(dest);
+        } else if (aExpr->children[1]->LH == "SLASH") {
+          Div(l,r) ;
+          Mflo(dest);
+        } else { // PCT
+          Div(l,r) ;
+          Mfhi(dest);
+        }
+        doneWith(o);
+    }
+  } else if (aExpr->LH == "factor") {
+    if (n >= 3 && aExpr->RH[0] == "ID" && inlineCall(aExpr, dest, procTable, vars)) {
+      // expanded in place
+    } else if (n == 1) { // ID or NUM
+      if (aExpr->children[0]->LH == "ID") {
+        typeNode(aExpr, vars, procTable);
+        int slot = aExpr->getChild("ID",1)->slot;
+        if (!frame.home(slot)) {
+          Lw(dest,frame.at(slot),29);
+        } else if (frame.home(slot) != dest) {
+          Add(dest,frame.home(slot),0);
+        }
+        return;
+      } else { // NUM
+        typeNode(aExpr->children[0], vars, procTable);
+        if (aExpr->children[0]->LH == "NUM") { // NUM
+          constant(dest, stoll(aExpr->getChild("NUM",1)->RH[0]));
+        } else { // NULL = 1
+          constant(dest,1);
+        }
+      }
+    } else if (n == 2) {
+      if (aExpr->RH[0] == "AMP") { // AMP lvalue
+        lvalueCode(aExpr->getChild("lvalue",1),dest,procTable,vars) ;
+      } else { // STAR factor
+        aCode(aExpr->getChild("factor",1),dest,procTable,vars) ;
+        Lw(dest,0,dest);
+      }
+    } else if (n == 3) { 
+      if (aExpr->RH[0] == "ID") { // ID LPAREN RPAREN
+        vector<int> saved = saveLive();
+        if (!calleeLinks) push(29);
+        Call("P" + aExpr->getChild("ID",1)->RH[0]);
+        if (!calleeLinks) pop(29); // restore frame pointer
+        restoreLive(saved);
+        if (dest != 3) Add(dest,3,0);
+      } else { // LPAREN expr RPAREN
+        aCode(aExpr->getChild("expr",1),dest,procTable,vars);
+      }
+    } else if (n == 5) { // NEW INT LBRACK expr RBRACK
+      aCode(aExpr->getChild("expr",1),1,procTable,vars) ;
+      Call("new");
+      int newLabel = emitter.fresh();
+      Bne(3,0,newLabel);
+      Lis(3);
+      Word(1);
+      Label(newLabel);
+      if (dest != 3) Add(dest,3,0);
+    } else { // ID LPAREN arglist RPAREN
+      vector<int> saved = saveLive();
+      if (!calleeLinks) push(29); // save current frame pointer
+      Tree * arglst = aExpr->getChild("arglist", 1);
+      int args = 0;
+      vector<pair<int, int>> moves;  // argument register <- where the value is
+      vector<pair<int, int>> parked; // argument register <- word pushed, with no temporary free
+      // evaluate arguments
+      while (true) {
+        Tree * arg = arglst->getChild("expr", 1);
+        int k = moves.size() + parked.size();
+        int r = regArgs && k < REG_ARGS ? varReg(arg, procTable, vars) : 0;
+        if (!r && regArgs && k < REG_ARGS) {
+          r = temps.alloc();
+          if (r >= 0) {
+            aCode(arg, r, procTable, vars);
+            temps.define(r);
+          }
+        }
+        if (r > 0) {
+          moves.push_back({ARG_REGS[k], r});
+        } else {
+          if (r < 0) parked.push_back({ARG_REGS[k], args});
+          aCode(arg,3,procTable,vars);
+          push(3);
+          ++args;
+        }
+        if ((arglst->children).size() > 1) {
+          arglst = arglst->getChild("arglist",1);
+        } else {
+           break;
+        }
+      }
+      for (auto & m: moves) {
+        if (isTemp(m.second)) temps.release(m.second);
+      }
+      parallelMove(moves);
+      for (auto & p: parked) {
+        Lw(p.first, 4 * (args - p.second - 1), 30);
+      }
+      argsInRegs += moves.size() + parked.size();
+      argsPushed += args - parked.size();
+      Call("P" + aExpr->getChild("ID",1)->RH[0]);
+      Flush(4 * args); // pop arguments
+      if (!calleeLinks) pop(29); // restore frame pointer
+      restoreLive(saved);
+      if (dest != 3) Add(dest,3,0);
+    }
+  }
+  typeNode(aExpr, vars, procTable);
+}
+// test expr1 [] expr2 : $l <- expr1, $r <- expr2, then a branch to label
+// taken when the test comes out as when
+void testCode(Tree * test, bool when, int label, ProcedureTable & procTable, VariableTable * vars) {
+  string op = test->RH[1];
+  Operands o = operands(test->getChild("expr",1), test->getChild("expr",2), 3, procTable, vars);
+  int l = o.l, r = o.r;
+  // pointers compare unsigned, ints signed
+  bool ptr = (test->getChild("expr",1)->type == "int*");
+  if (op == "EQ") {
+    when ? Beq(r,l,label) : Bne(r,l,label);
+  } else if (op == "NE") {
+    when ? Bne(r,l,label) : Beq(r,l,label);
+  } else if (op == "LT" || op == "GT") {
+    if (op == "LT") {
+      ptr ? Sltu(3,l,r) : Slt(3,l,r); // expr1 < expr2
+    } else {
+      ptr ? Sltu(3,r,l) : Slt(3,r,l); // expr2 < expr1
+    }
+    when ? Bne(3,0,label) : Beq(3,0,label);
+  } else { // LE or GE: the test holds when the opposite slt gives 0
+    if (op == "LE") {
+      ptr ? Sltu(3,r,l) : Slt(3,r,l); // expr2 < exp1 == !(exp1 <= expr2)
+    } else {
+      ptr ? Sltu(3,l,r) : Slt(3,l,r); // expr1 < exp2 == !(exp1 >= expr2)
+    }
+    if (when) {
+      Beq(3,0,label);
+    } else {
+      constant(5,1);
+      Beq(3,5,label);
+    }
+  }
+  doneWith(o);
+}
+// WHILE loops are emitted with the test at the bottom as well as in front, so
+// an iteration takes one branch rather than two
+bool rotateLoops = false;
+long rotated = 0;
+
+// WLP4 has no early return, so a procedure recurses through an IF and returns
+// a variable. Assigning a call to itself to that variable as the last thing
+// the body does is a tail call: the new arguments replace the parameters and
+// the body starts over in the same frame
+struct TailCalls {
+  bool enabled = false;
+  string name;                 // the current procedure
+  int entry = -1;              // label after its prologue
+  map<Tree*, bool> sites;      // its statements that are tail calls
+  long count = 0;
+};
+TailCalls tails;
+// the call to name expr is, through parentheses, or nullptr
+Tree * selfCall(Tree * expr, const string & name) {
+  while (true) {
+    while (expr->same) expr = expr->same;
+    if (expr->isConst || expr->children.empty()) return nullptr;
+    if (expr->RH.size() == 1) {
+      expr = expr->children[0];
+    } else if (expr->RH[0] == "LPAREN") {
+      expr = expr->children[1];
+    } else if (expr->LH == "factor" && expr->RH[0] == "ID") {
+      return expr->children[0]->RH[0] == name ? expr : nullptr;
+    } else {
+      return nullptr;
+    }
+  }
+}
+// finds the assignments of a call to name to v that are the last statement
+// run, directly or as the last of either branch of a last IF
+void collectTails(Tree * stmts, const string & v, const string & name) {
+  if (stmts->children.empty()) return;
+  Tree * stmt = stmts->getChild("statement",1);
+  if (stmt->RH[0] == "IF") {
+    collectTails(stmt->getChild("statements",1), v, name);
+    collectTails(stmt->getChild("statements",2), v, name);
+  } else if (stmt->RH.size() == 4) {
+    Tree * id = lvalueID(stmt->getChild("lvalue",1));
+    Tree * call = selfCall(stmt->getChild("expr",1), name);
+    int args = 0;
+    for (Tree * a = call && call->RH.size() == 4 ? call->getChild("arglist",1) : nullptr; a;
+         a = a->children.size() > 1 ? a->getChild("arglist",1) : nullptr) {
+      ++args;
+    }
+    // every argument is held in a temporary until the parameters are replaced
+    if (id && id->RH[0] == v && call && args <= LAST_TEMP - FIRST_TEMP + 1) tails.sites[stmt] = true;
+  }
+}
+void tailCall(Tree * stmt, Procedure & proc, ProcedureTable & procTable, VariableTable * vars) {
+  Tree * call = selfCall(stmt->getChild("expr",1), proc.name);
+  vector<int> regs;
+  for (Tree * args = call->RH.size() == 4 ? call->getChild("arglist",1) : nullptr; args;
+       args = args->children.size() > 1 ? args->getChild("arglist",1) : nullptr) {
+    Tree * arg = args->getChild("expr",1);
+    int slot = proc.signature.size() - regs.size();
+    // the last argument can go straight into a promoted parameter, since no
+    // other argument is left to read it. A parameter nothing reads has no
+    // word to go to, as in loadParams, so only the calls in its argument run
+    if (frame.isUnread(slot)) {
+      if (hasCalls(arg)) aCode(arg, 3, procTable, vars);
+      regs.push_back(0);
+    } else if (args->children.size() == 1 && frame.home(slot)) {
+      aCode(arg, frame.home(slot), procTable, vars);
+      regs.push_back(0);
+    } else {
+      int r = temps.alloc();
+      aCode(arg, r, procTable, vars);
+      temps.define(r);
+      regs.push_back(r);
+    }
+  }
+  for (int i = 0; i < (int) regs.size(); ++i) {
+    int slot = proc.signature.size() - i;
+    if (!regs[i]) continue;
+    if (frame.home(slot)) {
+      Add(frame.home(slot), regs[i], 0);
+    } else {
+      Sw(regs[i], frame.at(slot), 29);
+    }
+    temps.release(regs[i]);
+  }
+  if (vars) annoteTypes(stmt, *vars, procTable, fusedDiags);
+  if (!calleeLinks) Flush(4 * frame.stackLocals); // the locals are pushed again
+  Beq(0, 0, tails.entry);
+  ++tails.count;
+}
+void statements(Tree * stmtTree, ProcedureTable & procTable, VariableTable * vars) {
+  if (!((stmtTree->children).empty())) {
+    statements(stmtTree->getChild("statements",1), procTable, vars);
+    Tree* stmt = stmtTree->getChild("statement",1);
+    int n = stmt->RH.size() ;
+    if (tails.sites.count(stmt)) { // v = f(...) as the last thing f does
+      tailCall(stmt, procTable.Get(tails.name), procTable, vars);
+    } else if (n == 4) { // lvalue BECOMES expr SEMI
+      Tree * lvalue = stmt->getChild("lvalue",1) ;
+      Tree * id = lvalueID(lvalue);
+      if (id) { // lvalue -> ID
+        if (vars) annoteTypes(lvalue, *vars, procTable, fusedDiags);
+        if (frame.isUnread(id->slot)) {
+          if (hasCalls(stmt->getChild("expr",1))) aCode(stmt->getChild("expr",1), 3, procTable, vars);
+        } else if (frame.home(id->slot)) {
+          aCode(stmt->getChild("expr",1), frame.home(id->slot), procTable, vars);
+        } else {
+          aCode(stmt->getChild("expr",1), 3, procTable, vars);
+          Sw(3,frame.at(id->slot),29) ;
+        }
+      } else { // lvalue -> STAR factor: the address is the factor's value
+        Tree * inner = lvalue;
+        while (inner->RH.size() == 3) inner = inner->getChild("lvalue",1);
+        Operands o = operands(inner->getChild("factor",1), stmt->getChild("expr",1), 3, procTable, vars);
+        Sw(o.r,0,o.l);
+        doneWith(o);
+        typeLvalue(lvalue, vars, procTable);
+      }
+    } else if (n == 5) { 
+      if (stmt->RH[0] == "PRINTLN") { // PRINTLN LPAREN expr RPAREN SEMI
+        aCode(stmt->getChild("expr", 1), 1, procTable, vars) ;
+        Call("print");
+      } else { // DELETE LBRACK RBRACK expr SEMI
+        aCode(stmt->getChild("expr",1), 1, procTable, vars);
+        int newLabel = emitter.fresh();
+        Lis(5);
+        Word(1);
+        Beq(1,5,newLabel); // if $1 = 1 then NULL so do nothing
+        Call("delete");
+        Label(newLabel);
+      }
+    } else { // WHILE or IF
+      int jumpTo = emitter.fresh();
+      Tree * test = stmt->getChild("test",1);
+      if (stmt->children[0]->LH == "IF") { // IF
+        testCode(test, false, jumpTo, procTable, vars); // to else
+        int End = emitter.fresh();
+        statements(stmt->getChild("statements",1), procTable, vars);
+        Beq(0,0,End);
+        Label(jumpTo);
+        statements(stmt->getChild("statements",2), procTable, vars);
+        Label(End);
+        
+      } else if (rotateLoops) { // WHILE as if (test) do body while (test)
+        int body = emitter.fresh();
+        testCode(test, false, jumpTo, procTable, vars);
+        Label(body);
+        statements(stmt->getChild("statements",1), procTable, vars);
+        testCode(test, true, body, procTable, vars);
+        Label(jumpTo);
+        ++rotated;
+      } else { // WHILE
+        int whileLabel = emitter.fresh();
+        Label(whileLabel);
+        testCode(test, false, jumpTo, procTable, vars);
+        statements(stmt->getChild("statements",1), procTable, vars);
+        Beq(0,0,whileLabel);
+        Label(jumpTo);
+      }
+    }
+    if (vars) checkStatement(stmt, fusedDiags);
+  }
+} 
+// expands call in place if its procedure is a candidate and there are
+// temporaries for all of its variables, keeping two for the body's expressions
+bool inlineCall(Tree * call, int dest, ProcedureTable & procTable, VariableTable * vars) {
+  string name = call->getChild("ID",1)->RH[0];
+  auto it = inliner.candidates.find(name);
+  Procedure & callee = procTable.Get(name);
+  int free = LAST_TEMP - FIRST_TEMP + 1 - temps.used.count();
+  if (it == inliner.candidates.end() || free < (int) callee.symTable.varTable.size() + 2) {
+    if (it != inliner.candidates.end()) ++inliner.declined;
+    ++inliner.outOfLine[name];
+    return false;
+  }
+  Inliner::Candidate & c = it->second;
+  Frame inner;
+  inner.lowest = -callee.locals;
+  inner.reg.assign(callee.locals + callee.signature.size() + 1, 0);
+  inner.offset.assign(inner.reg.size(), 0);
+  inner.taken.assign(inner.reg.size(), false);
+  vector<int> held;
+  // arguments left to right, as a call pushes them. A promoted variable the
+  // body never assigns to is read where it is
+  int slot = callee.signature.size();
+  for (Tree * args = call->RH.size() == 4 ? call->getChild("arglist",1) : nullptr; args;
+       args = args->children.size() > 1 ? args->getChild("arglist",1) : nullptr) {
+    Tree * arg = args->getChild("expr",1);
+    int r = varReg(arg, procTable, vars);
+    if (!r || c.assigned.count(slot)) {
+      r = temps.alloc();
+      aCode(arg, r, procTable, vars);
+      temps.define(r);
+      temps.vars[r] = true;
+      held.push_back(r);
+    }
+    inner.reg[slot-- - inner.lowest] = r;
+  }
+  for (slot = -1; slot >= inner.lowest; --slot) {
+    int r = temps.alloc();
+    temps.define(r);
+    temps.vars[r] = true;
+    held.push_back(r);
+    inner.reg[slot - inner.lowest] = r;
+  }
+  Frame outer = frame;
+  frame = inner;
+  declarations(c.tree->getChild("dcls",1));
+  statements(c.tree->getChild("statements",1), procTable, nullptr);
+  aCode(c.tree->getChild("expr",1), dest, procTable, nullptr);
+  frame = outer;
+  for (int r: held) temps.release(r);
+  ++inliner.expanded[name];
+  return true;
+}
+// in fused mode builds the procedure's symbol table here instead of in collectProcedures
+VariableTable * fusedSymbols(Tree * procTree, ProcedureTable & procTable, bool fused) {
+  if (!fused) return nullptr;
+  Procedure newProc = Procedure(procTree, fusedDiags);
+  if (!procTable.Add(newProc)) fusedDiags.error(procTree->getChild("ID",1), "duplicate procedure definition " + newProc.name) ;
+  return &procTable.Get(newProc.name).symTable;
+}
+void fusedReturn(Tree * procTree, VariableTable * vars) {
+  if (vars) checkReturn(procTree, fusedDiags);
+}
+// copies promoted params from the caller's pushes into their registers
+void loadParams(Procedure & proc, int fp = 29, int bias = 0) {
+  int params = proc.name == "main" ? 0 : proc.signature.size();
+  for (auto & v: proc.symTable.varTable) {
+    int slot = v.second.slot, reg = argReg(slot, params);
+    if (reg && frame.home(slot)) {
+      Add(frame.home(slot), reg, 0);
+    } else if (reg && !frame.isUnread(slot)) {
+      Sw(reg, frame.at(slot), 29);
+    } else if (slot >= 0 && frame.home(slot)) {
+      Lw(frame.home(slot), slot * 4 + bias, fp);
+    }
+  }
+}
+// with calleeLinks the frame is made with one change to $30. $29 is where
+// a call used to push $31, just below the arguments, and $31 goes there
+// unless the procedure is a leaf; then come the caller's $29, the saved
+// registers and the stack locals. A frameless leaf has only saved registers,
+// from 0($29) down, and addresses them and the arguments from $30
+int frameSize() { // bytes below the caller's $30
+  return 4 * (frame.links + 1 + frame.saved.size() + frame.stackLocals);
+}
+void framePrologue(Procedure & proc) {
+  if (!frame.frameless) {
+    if (!frame.leaf) Sw(31,-4,30);
+    Sw(29,-8,30);
+    Sub(29,30,4);
+  }
+  Reserve(frameSize());
+  for (int i = 0; i < (int) frame.saved.size(); ++i) {
+    Sw(frame.saved[i], frame.bias - 4 * (frame.links + i + 1), frame.fp);
+  }
+  loadParams(proc, frame.fp, frame.bias);
+}
+void frameEpilogue() {
+  for (int i = 0; i < (int) frame.saved.size(); ++i) {
+    Lw(frame.saved[i], frame.bias - 4 * (frame.links + i + 1), frame.fp);
+  }
+  if (frame.frameless) {
+    Release(frameSize());
+  } else {
+    Add(30,29,4);
+    if (!frame.leaf) Lw(31,-4,30);
+    Lw(29,-8,30);
+  }
+  Jr(31);
+}
+void procCode (Tree* procTree, ProcedureTable& procTable, bool fused) {  // procedure -> INT ID LPARENS params
+  VariableTable * vars = fusedSymbols(procTree, procTable, fused);
+  string procID = procTree->getChild("ID",1)->RH[0] ;
+  // params were given slots by the Procedure constructor
+  Procedure & proc = procTable.Get(procID);
+  planFrame(procTree, proc, true);
+  emitter.begin();
+  procBlock[procID] = emitter.procs.size() - 1;
+  Label("P" + procID); // initialize procedure
+  if (calleeLinks) {
+    framePrologue(proc);
+  } else {
+    Sub(29,30,0); // initialize frame pointer
+    for (int r: frame.saved) {
+      push(r);
+    }
+    loadParams(proc);
+  }
+  tails.sites.clear();
+  Tree * result = useOf(procTree->getChild("expr",1));
+  // a pointer to a parameter or local may still be live when the next
+  // iteration overwrites the frame, so a procedure that takes addresses keeps its calls
+  if (tails.enabled && result && !frame.anyTaken) collectTails(procTree->getChild("statements",1), result->RH[0], procID);
+  if (!tails.sites.empty()) {
+    tails.name = procID;
+    tails.entry = emitter.fresh();
+    Label(tails.entry);
+  }
+  // code for dcls
+  declarations(procTree->getChild("dcls",1));
+  // code for statements
+  statements(procTree->getChild("statements", 1), procTable, vars) ;
+  // code for expr
+  aCode(procTree->getChild("expr", 1), 3, procTable, vars) ;
+  fusedReturn(procTree, vars);
+  if (calleeLinks) {
+    frameEpilogue();
+    return;
+  }
+  for (int i = 0; i < (int) frame.saved.size(); ++i) {
+    Lw(frame.saved[i], -4 * (i + 1), 29);
+  }
+  Flush(4 * (frame.saved.size() + frame.stackLocals));
+  Jr(31);
+}
+// generate entire code
+
+void wain(Tree* wainTree, ProcedureTable & procTable, bool fused) { // main -> INT WAIN ...
+  VariableTable * vars = fusedSymbols(wainTree, procTable, fused);
+  Procedure & proc = procTable.Get("main");
+  planFrame(wainTree, proc, false);
+  emitter.begin();
+  procBlock["main"] = emitter.procs.size() - 1;
+  Label("main");
+  // 2 params of wain, slots 1 and 0
+  push(1) ; // push $1 to stack
+  push(2) ; // push $2 to stack
+  Sub(29,30,0); // set $29 to first variable on stack
+  if (calleeLinks) { // nothing needs the loader's $29
+    Sw(31,-4,29);
+    Reserve(4 * (frame.links + frame.stackLocals));
+  }
+  loadParams(proc);
+  if (proc.signature[0] == "int") {
+    Add(2,0,0); // no array for init
+  }
+  Call("init");
+  // code for declarations
+  declarations(wainTree->getChild("dcls", 1));
+  // code for statements
+  statements(wainTree->getChild("statements", 1), procTable, vars) ;
+  // code for expr
+  aCode(wainTree->getChild("expr", 1), 3, procTable, vars) ;
+  fusedReturn(wainTree, vars);
+  if (calleeLinks) {
+    Lw(31,-4,29);
+    Add(30,29,4); // and the words $1 and $2 were pushed to
+    Add(30,30,4);
+  } else {
+    Flush(8 + 4 * frame.stackLocals);
+  }
+  Jr(31);
+}
+
+void codeGen(Tree* procTree, ProcedureTable & procTable, bool fused) {
+  emitter.begin();
+  Import("print");
+  Import("new");
+  Import("delete");
+  Import("init");
+  constant(4,4);
+  Beq(0,0,"main");
+  while (true) {
+    if (procTree->children.size() > 1) {
+      procCode(procTree->getChild("procedure",1), procTable, fused) ;
+      procTree = procTree->getChild("procedures", 1) ;
+    } else {
+      wain(procTree->getChild("main",1), procTable, fused);
+      break;
+    }
+  }
+}
+
+// the SSA IR behind -O3. Each procedure is lowered from the checked, folded
+// tree into blocks of instructions, and an instruction's id is the value it
+// produces, typed int or int*. Variables whose address is never taken become
+// values as they are assigned, with phis placed as the lowering reads them
+// (Braun et al., "Simple and Efficient Construction of SSA Form"); the others
+// keep their stack word and are reached with load and store. Passes run over
+// it from a pass manager, then MIPS is selected from it
+enum IROp : unsigned char {
+  IR_CONST,  // imm
+  IR_PARAM,  // the word the caller pushed for parameter slot imm
+  IR_ADDR,   // address of the stack word of variable slot imm
+  IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_MOD,
+  IR_MULHI,  // high word of the signed product
+  IR_SLT,    // 1 if args[0] < args[1], else 0
+  IR_LOAD,   // from args[0] + imm
+  IR_STORE,  // args[1] to args[0] + imm
+  IR_CALL,   // procedure name with args
+  IR_NEW, IR_DELETE, IR_PRINT,
+  IR_PHI,    // an argument per predecessor, in their order
+  IR_BR,     // to succs[0] if args[0] <imm> args[1], else to succs[1]
+  IR_JMP,
+  IR_RET
+};
+const char * IR_NAMES[] = {
+  "const", "param", "addr", "add", "sub", "mul", "div", "mod", "mulhi", "slt", "load", "store",
+  "call", "new", "delete", "print", "phi", "br", "jmp", "ret"
+};
+enum IRType : unsigned char { IR_VOID, IR_INT, IR_PTR };
+const char * IR_TYPES[] = {"void", "int", "int*"};
+// BR's imm, in the order of test's operators
+enum IRCmp { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GE, CMP_GT };
+const char * CMP_NAMES[] = {"eq", "ne", "lt", "le", "ge", "gt"};
+
+struct IRInstr {
+  IROp op;
+  IRType type;
+  int block;          // -1 once removed
+  int imm;
+  vector<int> args;
+  string name;        // procedure called
+};
+struct IRBlock {
+  vector<int> phis;
+  vector<int> code;   // terminator last
+  vector<int> preds, succs;
+};
+struct IRFunction {
+  string name;
+  Procedure * proc;
+  vector<IRInstr> values;
+  vector<IRBlock> blocks;
+  vector<pair<int, int>> loops; // preheader and header of each WHILE, outer ones first
+
+  bool alive(int v) { return values[v].block >= 0; }
+  void remove(int v) { values[v].block = -1; }
+  // drops removed instructions from the blocks
+  void compact() {
+    for (auto & b: blocks) {
+      auto gone = [&](int v) { return values[v].block < 0; };
+      b.phis.erase(remove_if(b.phis.begin(), b.phis.end(), gone), b.phis.end());
+      b.code.erase(remove_if(b.code.begin(), b.code.end(), gone), b.code.end());
+    }
+  }
+  // reverse postorder from the entry; the first successor comes first, so it
+  // is laid out right after its block where it can be
+  vector<int> rpo() {
+    vector<int> post;
+    vector<bool> seen(blocks.size(), false);
+    vector<pair<int, int>> stack{{0, (int) blocks[0].succs.size() - 1}};
+    seen[0] = true;
+    while (!stack.empty()) {
+      int b = stack.back().first;
+      int & next = stack.back().second;
+      if (next >= 0) {
+        int s = blocks[b].succs[next--];
+        if (!seen[s]) {
+          seen[s] = true;
+          stack.push_back({s, (int) blocks[s].succs.size() - 1});
+        }
+      } else {
+        post.push_back(b);
+        stack.pop_back();
+      }
+    }
+    return vector<int>(post.rbegin(), post.rend());
+  }
+  void print(ostream & out);
+};
+
+void IRFunction::print(ostream & out) {
+  out << "proc " << name << "\n";
+  for (int b: rpo()) {
+    IRBlock & block = blocks[b];
+    out << "b" << b << ":";
+    if (!block.preds.empty()) {
+      out << " ; preds";
+      for (int p: block.preds) out << " b" << p;
+    }
+    out << "\n";
+    auto line = [&](int v) {
+      IRInstr & i = values[v];
+      out << "  ";
+      if (i.type != IR_VOID) out << "%" << v << " = ";
+      out << IR_NAMES[i.op];
+      if (i.op == IR_BR) out << " " << CMP_NAMES[i.imm];
+      if (i.type != IR_VOID) out << " " << IR_TYPES[i.type];
+      if (i.op == IR_CALL) out << " " << i.name;
+      for (int a = 0; a < (int) i.args.size(); ++a) {
+        out << (a ? ", %" : " %") << i.args[a];
+        if (i.op == IR_PHI) out << " b" << block.preds[a];
+      }
+      if (i.op == IR_CONST || i.op == IR_PARAM || i.op == IR_ADDR) out << " " << i.imm;
+      if ((i.op == IR_LOAD || i.op == IR_STORE) && i.imm) out << " +" << i.imm;
+      for (int s: (i.op == IR_BR || i.op == IR_JMP) ? block.succs : vector<int>()) out << " b" << s;
+      out << "\n";
+    };
+    for (int v: block.phis) line(v);
+    for (int v: block.code) line(v);
+  }
+}
+
+// 32-bit results the way the generated code computes them, as fold does
+bool foldIR(IROp op, int a, int b, int & out) {
+  unsigned x = a, y = b;
+  switch (op) {
+    case IR_ADD: out = x + y; return true;
+    case IR_SUB: out = x - y; return true;
+    case IR_MUL: out = x * y; return true;
+    case IR_DIV: case IR_MOD:
+      if (y == 0 || (x == 0x80000000 && y == 0xffffffff)) return false;
+      out = op == IR_DIV ? a / b : a % b;
+      return true;
+    case IR_MULHI: out = ((long long) a * b) >> 32; return true;
+    case IR_SLT: out = a < b; return true;
+    default:
+      return false;
+  }
+}
+
+// lowers one procedure
+struct IRBuilder {
+  IRFunction & f;
+  map<int, bool> taken;           // slots of variables named under &
+  map<int, IRType> varType;       // by slot
+  vector<map<int, int>> defs;     // per block: slot -> its value at the end so far
+  vector<bool> sealed;            // all predecessors known
+  map<int, vector<pair<int, int>>> incomplete; // block -> (slot, phi) to fill when sealed
+  int cur = 0;
+
+  IRBuilder(IRFunction & f) : f{f} {}
+  int block() {
+    f.blocks.push_back(IRBlock());
+    defs.push_back(map<int, int>());
+    sealed.push_back(false);
+    return f.blocks.size() - 1;
+  }
+  int add(IROp op, IRType type, vector<int> args, int imm = 0, int at = -1) {
+    if (at < 0) at = cur;
+    f.values.push_back(IRInstr{op, type, at, imm, args, ""});
+    int v = f.values.size() - 1;
+    (op == IR_PHI ? f.blocks[at].phis : f.blocks[at].code).push_back(v);
+    return v;
+  }
+  int constant(int k, IRType type = IR_INT) {
+    return add(IR_CONST, type, {}, k);
+  }
+  int arith(IROp op, IRType type, int a, int b) {
+    int k;
+    if (f.values[a].op == IR_CONST && f.values[b].op == IR_CONST &&
+        foldIR(op, f.values[a].imm, f.values[b].imm, k)) return constant(k, type);
+    return add(op, type, {a, b});
+  }
+  int scale(int v) { // an int that indexes words
+    return arith(IR_MUL, IR_INT, v, constant(4));
+  }
+  void edge(int from, int to) {
+    f.blocks[from].succs.push_back(to);
+    f.blocks[to].preds.push_back(from);
+  }
+  void jump(int to) {
+    add(IR_JMP, IR_VOID, {});
+    edge(cur, to);
+  }
+
+  void write(int slot, int b, int v) {
+    defs[b][slot] = v;
+  }
+  int read(int slot, int b) {
+    auto it = defs[b].find(slot);
+    if (it != defs[b].end()) return it->second;
+    int v;
+    if (!sealed[b]) {
+      v = add(IR_PHI, varType[slot], {}, 0, b);
+      incomplete[b].push_back({slot, v});
+    } else if (f.blocks[b].preds.size() == 1) {
+      v = read(slot, f.blocks[b].preds[0]);
+    } else {
+      v = add(IR_PHI, varType[slot], {}, 0, b);
+      write(slot, b, v); // a loop back to b finds the phi
+      fillPhi(slot, v);
+    }
+    write(slot, b, v);
+    return v;
+  }
+  void fillPhi(int slot, int phi) {
+    int b = f.values[phi].block;
+    for (int i = 0; i < (int) f.blocks[b].preds.size(); ++i) {
+      int v = read(slot, f.blocks[b].preds[i]);
+      f.values[phi].args.push_back(v);
+    }
+  }
+  void seal(int b) {
+    auto it = incomplete.find(b);
+    sealed[b] = true;
+    if (it == incomplete.end()) return;
+    for (auto & p: it->second) fillPhi(p.first, p.second);
+    incomplete.erase(it);
+  }
+
+  IRType typeOf(Tree * n) {
+    return n->type == "int*" ? IR_PTR : IR_INT;
+  }
+  int expr(Tree * n) {
+    while (n->same) n = n->same;
+    if (n->isConst) return constant(n->value);
+    if (n->LH == "expr" || n->LH == "term") {
+      if (n->RH.size() == 1) return expr(n->children[0]);
+      Tree * a = n->children[0], * b = n->children[2];
+      int x = expr(a), y = expr(b);
+      string op = n->RH[1];
+      if (op == "PLUS") {
+        if (typeOf(a) == IR_PTR) return arith(IR_ADD, IR_PTR, x, scale(y));
+        if (typeOf(b) == IR_PTR) return arith(IR_ADD, IR_PTR, scale(x), y);
+        return arith(IR_ADD, IR_INT, x, y);
+      }
+      if (op == "MINUS") {
+        if (typeOf(a) == IR_PTR && typeOf(b) == IR_PTR) {
+          return arith(IR_DIV, IR_INT, arith(IR_SUB, IR_INT, x, y), constant(4));
+        }
+        if (typeOf(a) == IR_PTR) return arith(IR_SUB, IR_PTR, x, scale(y));
+        return arith(IR_SUB, IR_INT, x, y);
+      }
+      return arith(op == "STAR" ? IR_MUL : op == "SLASH" ? IR_DIV : IR_MOD, IR_INT, x, y);
+    }
+    // factor
+    string first = n->RH[0];
+    if (first == "ID" && n->RH.size() == 1) {
+      int slot = n->children[0]->slot;
+      if (taken.count(slot)) return add(IR_LOAD, varType[slot], {add(IR_ADDR, IR_PTR, {}, slot)});
+      return read(slot, cur);
+    }
+    if (first == "NUM") return constant(stoll(n->children[0]->RH[0]));
+    if (first == "NULL") return constant(1, IR_PTR);
+    if (first == "LPAREN") return expr(n->children[1]);
+    if (first == "AMP") return address(n->children[1]);
+    if (first == "STAR") return add(IR_LOAD, IR_INT, {expr(n->children[1])});
+    if (first == "NEW") return add(IR_NEW, IR_PTR, {expr(n->getChild("expr",1))});
+    // ID LPAREN [arglist] RPAREN, arguments left to right
+    vector<int> args;
+    for (Tree * a = n->RH.size() == 4 ? n->getChild("arglist",1) : nullptr; a;
+         a = a->children.size() > 1 ? a->getChild("arglist",1) : nullptr) {
+      args.push_back(expr(a->getChild("expr",1)));
+    }
+    int v = add(IR_CALL, IR_INT, args);
+    f.values[v].name = n->children[0]->RH[0];
+    return v;
+  }
+  int address(Tree * lvalue) {
+    if (lvalue->RH.size() == 1) return add(IR_ADDR, IR_PTR, {}, lvalue->children[0]->slot);
+    if (lvalue->RH.size() == 2) return expr(lvalue->getChild("factor",1));
+    return address(lvalue->getChild("lvalue",1));
+  }
+  // branches on test from the current block
+  void test(Tree * t, int yes, int no) {
+    static const map<string, int> cmps = {{"EQ", CMP_EQ}, {"NE", CMP_NE}, {"LT", CMP_LT},
+                                          {"LE", CMP_LE}, {"GE", CMP_GE}, {"GT", CMP_GT}};
+    int a = expr(t->getChild("expr",1));
+    int b = expr(t->getChild("expr",2));
+    add(IR_BR, IR_VOID, {a, b}, cmps.at(t->RH[1]));
+    edge(cur, yes);
+    edge(cur, no);
+  }
+  void statements(Tree * t) {
+    if (t->children.empty()) return;
+    statements(t->getChild("statements",1));
+    Tree * s = t->getChild("statement",1);
+    if (s->RH.size() == 4) { // lvalue BECOMES expr SEMI
+      Tree * lvalue = s->getChild("lvalue",1);
+      Tree * id = lvalueID(lvalue);
+      if (id && !taken.count(id->slot)) {
+        write(id->slot, cur, expr(s->getChild("expr",1)));
+      } else {
+        int a = address(lvalue);
+        add(IR_STORE, IR_VOID, {a, expr(s->getChild("expr",1))});
+      }
+    } else if (s->RH[0] == "PRINTLN") {
+      add(IR_PRINT, IR_VOID, {expr(s->getChild("expr",1))});
+    } else if (s->RH[0] == "DELETE") {
+      add(IR_DELETE, IR_VOID, {expr(s->getChild("expr",1))});
+    } else if (s->RH[0] == "IF") {
+      int yes = block(), no = block(), join = block();
+      test(s->getChild("test",1), yes, no);
+      seal(yes);
+      seal(no);
+      cur = yes;
+      statements(s->getChild("statements",1));
+      jump(join);
+      cur = no;
+      statements(s->getChild("statements",2));
+      jump(join);
+      seal(join);
+      cur = join;
+    } else { // WHILE, as if (test) { do body while (test) }, with a block to hoist into
+      int pre = block(), body = block(), exit = block();
+      f.loops.push_back({pre, body});
+      test(s->getChild("test",1), pre, exit);
+      seal(pre);
+      cur = pre;
+      jump(body);
+      cur = body;
+      statements(s->getChild("statements",1));
+      test(s->getChild("test",1), body, exit);
+      seal(body);
+      seal(exit);
+      cur = exit;
+    }
+  }
+  void findTaken(Tree * n) {
+    if (n->LH == "factor" && n->RH[0] == "AMP") {
+      Tree * id = lvalueID(n->getChild("lvalue",1));
+      if (id) taken[id->slot] = true;
+    }
+    for (auto c: n->children) findTaken(c);
+  }
+  void lower(Tree * procTree) {
+    for (auto & v: f.proc->symTable.varTable) {
+      varType[v.second.slot] = v.second.type == "int*" ? IR_PTR : IR_INT;
+    }
+    findTaken(procTree);
+    cur = block();
+    seal(cur);
+    for (auto & v: f.proc->symTable.varTable) {
+      int slot = v.second.slot;
+      if (slot >= 0 && !taken.count(slot)) write(slot, cur, add(IR_PARAM, varType[slot], {}, slot));
+    }
+    // declarations, in order
+    vector<Tree*> dcls;
+    for (Tree * d = procTree->getChild("dcls",1); !d->children.empty(); d = d->getChild("dcls",1)) {
+      dcls.push_back(d);
+    }
+    for (int i = dcls.size() - 1; i >= 0; --i) {
+      int slot = dcls[i]->getChild("dcl",1)->getChild("ID",1)->slot;
+      int v = dcls[i]->RH[3] == "NULL" ? constant(1, IR_PTR) : constant(stoll(dcls[i]->getChild("NUM",1)->RH[0]));
+      if (taken.count(slot)) {
+        add(IR_STORE, IR_VOID, {add(IR_ADDR, IR_PTR, {}, slot), v});
+      } else {
+        write(slot, cur, v);
+      }
+    }
+    statements(procTree->getChild("statements",1));
+    add(IR_RET, IR_VOID, {expr(procTree->getChild("expr",1))});
+  }
+};
+
+// checks the IR is well formed: block structure, phi arity, types, and that
+// every value is defined before it is used on all paths
+void verifyIR(IRFunction & f, ProcedureTable & procTable, const string & after) {
+  auto fail = [&](const string & what) {
+    throw runtime_error("ERROR: IR verification failed in " + f.name + " after " + after + ": " + what);
+  };
+  vector<int> rpo = f.rpo();
+  vector<vector<int>> preds;
+  for (auto & b: f.blocks) preds.push_back(b.preds);
+  vector<int> idom = immediateDominators(preds, rpo), pre, post;
+  numberDominatorTree(idom, 0, pre, post);
+  auto dominates = [&](int a, int b) { return pre[b] >= 0 && pre[a] <= pre[b] && post[b] <= post[a]; };
+  vector<int> index(f.values.size(), -1); // position in its block, phis all -1
+  for (int b: rpo) {
+    IRBlock & block = f.blocks[b];
+    for (int i = 0; i < (int) block.code.size(); ++i) index[block.code[i]] = i;
+    for (int s: block.succs) {
+      if (count(f.blocks[s].preds.begin(), f.blocks[s].preds.end(), b) != count(block.succs.begin(), block.succs.end(), s)) {
+        fail("edge b" + to_string(b) + " -> b" + to_string(s) + " not in its predecessors");
+      }
+    }
+  }
+  auto defined = [&](int v, int b, int at) { // v is available in block b before position at
+    if (v < 0 || v >= (int) f.values.size() || !f.alive(v)) fail("use of removed value %" + to_string(v));
+    int d = f.values[v].block;
+    if (f.values[v].type == IR_VOID) fail("use of %" + to_string(v) + ", which has no value");
+    if (d == b) {
+      if (index[v] >= at) fail("%" + to_string(v) + " used before it is defined");
+    } else if (!dominates(d, b)) {
+      fail("%" + to_string(v) + " does not dominate its use in b" + to_string(b));
+    }
+  };
+  for (int b: rpo) {
+    IRBlock & block = f.blocks[b];
+    if (block.code.empty()) fail("b" + to_string(b) + " is empty");
+    for (int v: block.phis) {
+      IRInstr & i = f.values[v];
+      if (i.op != IR_PHI || i.block != b) fail("%" + to_string(v) + " is not a phi of b" + to_string(b));
+      if (i.args.size() != block.preds.size()) fail("phi %" + to_string(v) + " has the wrong number of arguments");
+      for (int a = 0; a < (int) i.args.size(); ++a) {
+        defined(i.args[a], block.preds[a], f.blocks[block.preds[a]].code.size());
+        if (f.values[i.args[a]].type != i.type) fail("phi %" + to_string(v) + " mixes types");
+      }
+    }
+    for (int k = 0; k < (int) block.code.size(); ++k) {
+      int v = block.code[k];
+      IRInstr & i = f.values[v];
+      if (i.block != b) fail("%" + to_string(v) + " is listed in the wrong block");
+      bool last = k + 1 == (int) block.code.size();
+      if ((i.op >= IR_BR) != last) fail("b" + to_string(b) + " does not end in exactly one terminator");
+      if (i.op == IR_PHI) fail("phi %" + to_string(v) + " among the instructions");
+      for (int a: i.args) defined(a, b, k);
+      vector<IRType> t;
+      for (int a: i.args) t.push_back(f.values[a].type);
+      auto want = [&](bool ok) { if (!ok) fail("%" + to_string(v) + " (" + IR_NAMES[i.op] + ") has operands of the wrong type"); };
+      switch (i.op) {
+        case IR_CONST: case IR_PARAM: want(t.empty() && i.type != IR_VOID); break;
+        case IR_ADDR: want(t.empty() && i.type == IR_PTR); break;
+        case IR_ADD:
+          want(t.size() == 2 && (t[0] == IR_INT || t[1] == IR_INT) &&
+               i.type == ((t[0] == IR_PTR || t[1] == IR_PTR) ? IR_PTR : IR_INT));
+          break;
+        case IR_SUB:
+          want(t.size() == 2 && (t[1] == IR_INT || t[0] == IR_PTR) &&
+               i.type == ((t[0] == IR_PTR && t[1] == IR_INT) ? IR_PTR : IR_INT));
+          break;
+        case IR_MUL: case IR_DIV: case IR_MOD: case IR_MULHI:
+          want(t.size() == 2 && t[0] == IR_INT && t[1] == IR_INT && i.type == IR_INT);
+          break;
+        case IR_SLT: want(t.size() == 2 && t[0] == t[1] && i.type == IR_INT); break;
+        case IR_LOAD: want(t.size() == 1 && t[0] == IR_PTR && i.type != IR_VOID); break;
+        case IR_STORE: want(t.size() == 2 && t[0] == IR_PTR && t[1] != IR_VOID); break;
+        case IR_CALL: {
+          vector<string> & sig = procTable.Get(i.name).signature;
+          bool ok = t.size() == sig.size() && i.type == IR_INT;
+          for (int a = 0; ok && a < (int) t.size(); ++a) ok = t[a] == (sig[a] == "int*" ? IR_PTR : IR_INT);
+          want(ok);
+          break;
+        }
+        case IR_NEW: want(t.size() == 1 && t[0] == IR_INT && i.type == IR_PTR); break;
+        case IR_DELETE: want(t.size() == 1 && t[0] == IR_PTR); break;
+        case IR_PRINT: want(t.size() == 1 && t[0] == IR_INT); break;
+        case IR_BR: want(t.size() == 2 && t[0] == t[1] && block.succs.size() == 2); break;
+        case IR_JMP: want(t.empty() && block.succs.size() == 1); break;
+        case IR_RET: want(t.size() == 1 && t[0] == IR_INT && block.succs.empty()); break;
+        default: break;
+      }
+    }
+  }
+}
+
+// phis whose arguments are all one value (or the phi itself) are that value
+bool removeTrivialPhis(IRFunction & f) {
+  vector<int> to(f.values.size());
+  for (int v = 0; v < (int) to.size(); ++v) to[v] = v;
+  auto find = [&](int v) {
+    while (to[v] != v) v = to[v] = to[to[v]];
+    return v;
+  };
+  bool any = false;
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (auto & b: f.blocks) {
+      for (int p: b.phis) {
+        if (!f.alive(p)) continue;
+        int same = -1;
+        bool trivial = true;
+        for (int a: f.values[p].args) {
+          a = find(a);
+          if (a == p || a == same) continue;
+          if (same >= 0) {
+            trivial = false;
+            break;
+          }
+          same = a;
+        }
+        if (trivial && same >= 0) {
+          to[p] = same;
+          f.remove(p);
+          changed = any = true;
+        }
+      }
+    }
+  }
+  if (!any) return false;
+  for (auto & i: f.values) {
+    if (i.block < 0) continue;
+    for (int & a: i.args) a = find(a);
+  }
+  f.compact();
+  return true;
+}
+
+bool hasEffect(const IRInstr & i) {
+  return i.op == IR_STORE || i.op == IR_CALL || i.op == IR_NEW || i.op == IR_DELETE ||
+         i.op == IR_PRINT || i.op >= IR_BR;
+}
+// removes instructions whose values nothing with an effect depends on
+bool deadCode(IRFunction & f) {
+  vector<bool> live(f.values.size(), false);
+  vector<int> work;
+  for (int v = 0; v < (int) f.values.size(); ++v) {
+    if (f.alive(v) && hasEffect(f.values[v])) {
+      live[v] = true;
+      work.push_back(v);
+    }
+  }
+  while (!work.empty()) {
+    int v = work.back();
+    work.pop_back();
+    for (int a: f.values[v].args) {
+      if (!live[a]) {
+        live[a] = true;
+        work.push_back(a);
+      }
+    }
+  }
+  bool changed = false;
+  for (int v = 0; v < (int) f.values.size(); ++v) {
+    if (f.alive(v) && !live[v]) {
+      f.remove(v);
+      changed = true;
+    }
+  }
+  if (changed) f.compact();
+  return changed;
+}
+
+// value numbering over the dominator tree (Briggs, Cooper and Simpson): an
+// instruction computing what a dominating one already did takes its value,
+// after folding constants and identities. A load takes the value last
+// loaded from or stored to the same address when nothing between them can
+// have written memory; a store through a pointer that is not a variable's
+// address, or a call, forgets everything known
+struct GVNStats {
+  long exprs = 0, loads = 0;
+} gvnStats;
+
+bool writesMemory(const IRInstr & i) {
+  return i.op == IR_STORE || i.op == IR_CALL || i.op == IR_NEW || i.op == IR_DELETE;
+}
+bool isArith(IROp op) {
+  return op >= IR_ADD && op <= IR_SLT;
+}
+bool isPure(IROp op) {
+  return op <= IR_SLT;
+}
+bool valueNumbering(IRFunction & f) {
+  int nb = f.blocks.size();
+  vector<int> rpo = f.rpo();
+  vector<vector<int>> preds, children(nb);
+  for (auto & b: f.blocks) preds.push_back(b.preds);
+  vector<int> idom = immediateDominators(preds, rpo);
+  for (int b: rpo) {
+    if (idom[b] >= 0) children[idom[b]].push_back(b);
+  }
+  vector<int> to(f.values.size());
+  for (int v = 0; v < (int) to.size(); ++v) to[v] = v;
+  auto find = [&](int v) {
+    while (to[v] != v) v = to[v] = to[to[v]];
+    return v;
+  };
+  vector<bool> writes(nb, false);
+  for (int b: rpo) {
+    for (int v: f.blocks[b].code) {
+      if (writesMemory(f.values[v])) writes[b] = true;
+    }
+  }
+  // whether memory on entry to b is as its immediate dominator left it: no
+  // block on a path between them writes
+  vector<int> seen(nb, -1);
+  auto clean = [&](int b) {
+    vector<int> work(preds[b]);
+    while (!work.empty()) {
+      int p = work.back();
+      work.pop_back();
+      if (p == idom[b] || seen[p] == b) continue;
+      seen[p] = b;
+      if (writes[p]) return false;
+      for (int q: preds[p]) work.push_back(q);
+    }
+    return true;
+  };
+  typedef map<pair<int, int>, int> Memory; // (address, offset) -> the value there
+  vector<Memory> memory(nb);
+  map<vector<int>, int> table;
+  bool changed = false;
+  auto replace = [&](int v, int by) {
+    to[v] = by;
+    f.remove(v);
+    changed = true;
+  };
+  auto isConst = [&](int v, int k) { return f.values[v].op == IR_CONST && f.values[v].imm == k; };
+  // a simpler value v is equal to, or -1
+  auto simplify = [&](int v) {
+    IRInstr & i = f.values[v];
+    int a = i.args[0], b = i.args[1], k;
+    if (f.values[a].op == IR_CONST && f.values[b].op == IR_CONST && foldIR(i.op, f.values[a].imm, f.values[b].imm, k)) {
+      i.op = IR_CONST;
+      i.imm = k;
+      i.args.clear();
+      changed = true;
+      return -1;
+    }
+    switch (i.op) {
+      case IR_ADD:
+        if (isConst(b, 0)) return a;
+        if (isConst(a, 0)) return b;
+        break;
+      case IR_SUB:
+        if (isConst(b, 0)) return a;
+        if (a == b) {
+          i.op = IR_CONST;
+          i.imm = 0;
+          i.args.clear();
+          changed = true;
+        }
+        break;
+      case IR_MUL:
+        if (isConst(b, 1)) return a;
+        if (isConst(a, 1)) return b;
+        if (isConst(a, 0)) return a;
+        if (isConst(b, 0)) return b;
+        break;
+      case IR_DIV:
+        if (isConst(b, 1)) return a;
+        break;
+      default:
+        break;
+    }
+    return -1;
+  };
+  // dominator tree preorder, undoing each block's entries on the way out
+  vector<vector<vector<int>>> added(nb);
+  vector<pair<int, bool>> stack{{0, false}};
+  while (!stack.empty()) {
+    int b = stack.back().first;
+    if (stack.back().second) {
+      for (auto & key: added[b]) table.erase(key);
+      added[b].clear();
+      stack.pop_back();
+      continue;
+    }
+    stack.back().second = true;
+    Memory mem;
+    if (b != 0 && clean(b)) mem = memory[idom[b]];
+    auto number = [&](int v, vector<int> key) {
+      auto it = table.find(key);
+      if (it != table.end()) {
+        replace(v, it->second);
+        ++gvnStats.exprs;
+      } else {
+        table[key] = v;
+        added[b].push_back(key);
+      }
+    };
+    for (int p: f.blocks[b].phis) {
+      IRInstr & i = f.values[p];
+      vector<int> key{IR_PHI, i.type, b};
+      for (int & a: i.args) key.push_back(a = find(a));
+      number(p, key);
+    }
+    for (int v: f.blocks[b].code) {
+      IRInstr & i = f.values[v];
+      for (int & a: i.args) a = find(a);
+      if (isArith(i.op)) {
+        int same = simplify(v);
+        if (same >= 0) {
+          replace(v, same);
+          ++gvnStats.exprs;
+          continue;
+        }
+      }
+      if (isPure(i.op)) {
+        vector<int> key{i.op, i.type, i.imm};
+        key.insert(key.end(), i.args.begin(), i.args.end());
+        if ((i.op == IR_ADD || i.op == IR_MUL || i.op == IR_MULHI) && key[3] > key[4]) swap(key[3], key[4]);
+        number(v, key);
+      } else if (i.op == IR_LOAD) {
+        auto it = mem.find({i.args[0], i.imm});
+        if (it != mem.end() && f.values[it->second].type == i.type) {
+          replace(v, it->second);
+          ++gvnStats.loads;
+        } else {
+          mem[{i.args[0], i.imm}] = v;
+        }
+      } else if (i.op == IR_STORE) {
+        if (f.values[i.args[0]].op == IR_ADDR) {
+          // another variable's word is untouched, but any pointer may be this one
+          for (auto it = mem.begin(); it != mem.end(); ) {
+            bool keep = it->first != make_pair(i.args[0], i.imm) && f.values[it->first.first].op == IR_ADDR;
+            it = keep ? next(it) : mem.erase(it);
+          }
+        } else {
+          mem.clear();
+        }
+        mem[{i.args[0], i.imm}] = i.args[1];
+      } else if (writesMemory(i)) {
+        mem.clear();
+      }
+    }
+    memory[b] = mem;
+    for (int c: children[b]) stack.push_back({c, false});
+  }
+  if (!changed) return false;
+  for (auto & i: f.values) {
+    if (i.block < 0) continue;
+    for (int & a: i.args) a = find(a);
+  }
+  f.compact();
+  return true;
+}
+
+// loop-invariant code motion for the WHILE loops the lowering recorded,
+// innermost first. An instruction whose operands are all defined outside the
+// loop, or already hoisted, moves to the end of the preheader, which only
+// runs when the loop body does. Arithmetic always can, but division only by
+// a constant other than zero. A load can when nothing in the loop may write
+// its word: a variable's word is written by a store to it, through a pointer
+// or by a call, any other by any write. A load through a pointer must also
+// run on every iteration, so it cannot fault where the loop would not have
+// the blocks of a WHILE loop: those that reach a latch, a predecessor of the
+// header other than the preheader, without passing the header. They are
+// marked in inLoop
+vector<int> naturalLoop(IRFunction & f, int preheader, int header, int mark, vector<int> & inLoop) {
+  vector<int> blocks{header}, work;
+  inLoop[header] = mark;
+  for (int p: f.blocks[header].preds) {
+    if (p != preheader) work.push_back(p);
+  }
+  while (!work.empty()) {
+    int b = work.back();
+    work.pop_back();
+    if (inLoop[b] == mark) continue;
+    inLoop[b] = mark;
+    blocks.push_back(b);
+    for (int p: f.blocks[b].preds) work.push_back(p);
+  }
+  return blocks;
+}
+
+struct LICMStats {
+  long loops = 0, hoisted = 0, loads = 0;
+} licmStats;
+
+bool hoistInvariants(IRFunction & f) {
+  int nb = f.blocks.size();
+  vector<int> rpo = f.rpo(), order(nb, -1), inLoop(nb, -1), pre, post;
+  for (int k = 0; k < (int) rpo.size(); ++k) order[rpo[k]] = k;
+  vector<vector<int>> preds;
+  for (auto & b: f.blocks) preds.push_back(b.preds);
+  numberDominatorTree(immediateDominators(preds, rpo), 0, pre, post);
+  auto dominates = [&](int a, int b) { return pre[a] <= pre[b] && post[b] <= post[a]; };
+  bool changed = false;
+  for (int l = f.loops.size() - 1; l >= 0; --l) {
+    int preheader = f.loops[l].first, header = f.loops[l].second;
+    if (order[header] < 0) continue;
+    ++licmStats.loops;
+    vector<int> blocks = naturalLoop(f, preheader, header, l, inLoop), latches;
+    for (int p: preds[header]) {
+      if (p != preheader) latches.push_back(p);
+    }
+    sort(blocks.begin(), blocks.end(), [&](int a, int b) { return order[a] < order[b]; });
+    bool writes = false, anywhere = false; // anything written, anything but a variable's word
+    set<int> written;                        // slots of variables stored to
+    for (int b: blocks) {
+      for (int v: f.blocks[b].code) {
+        IRInstr & i = f.values[v];
+        if (!writesMemory(i)) continue;
+        writes = true;
+        if (i.op == IR_STORE && f.values[i.args[0]].op == IR_ADDR) {
+          written.insert(f.values[i.args[0]].imm);
+        } else {
+          anywhere = true;
+        }
+      }
+    }
+    vector<int> & into = f.blocks[preheader].code;
+    for (int b: blocks) {
+      bool everyIteration = true;
+      for (int latch: latches) everyIteration = everyIteration && dominates(b, latch);
+      vector<int> & code = f.blocks[b].code;
+      for (int k = 0; k < (int) code.size(); ) {
+        int v = code[k];
+        IRInstr & i = f.values[v];
+        bool invariant = true;
+        for (int a: i.args) invariant = invariant && inLoop[f.values[a].block] != l;
+        if (invariant) {
+          if (i.op == IR_DIV || i.op == IR_MOD) {
+            invariant = f.values[i.args[1]].op == IR_CONST && f.values[i.args[1]].imm != 0;
+          } else if (i.op == IR_LOAD) {
+            IRInstr & base = f.values[i.args[0]];
+            invariant = base.op == IR_ADDR ? !anywhere && !written.count(base.imm) : !writes && everyIteration;
+          } else {
+            invariant = isPure(i.op);
+          }
+        }
+        if (!invariant) {
+          ++k;
+          continue;
+        }
+        code.erase(code.begin() + k);
+        into.insert(into.end() - 1, v);
+        i.block = preheader;
+        ++(i.op == IR_LOAD ? licmStats.loads : licmStats.hoisted);
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+// a new instruction, in no block's list yet
+int newInstr(IRFunction & f, IROp op, IRType type, vector<int> args, int imm, int block) {
+  f.values.push_back(IRInstr{op, type, block, imm, args, ""});
+  return f.values.size() - 1;
+}
+
+// induction variable strength reduction. A basic induction variable is a
+// phi in a loop header that the latch steps by a constant; a constant
+// multiple of one becomes a phi of its own, stepped by the product, so the
+// loop adds rather than multiplies. When every use of the multiple offsets a
+// loop-invariant value, as indexing an array does, each sum becomes such a
+// phi instead: a pointer stepping through the array
+struct StrengthStats {
+  long inductions = 0, pointers = 0, mults = 0, divs = 0;
+} strengthStats;
+
+bool reduceInductions(IRFunction & f) {
+  int nb = f.blocks.size();
+  vector<vector<int>> users(f.values.size());
+  for (int v = 0; v < (int) f.values.size(); ++v) {
+    if (!f.alive(v)) continue;
+    for (int a: f.values[v].args) users[a].push_back(v);
+  }
+  vector<int> inLoop(nb, -1), to(f.values.size());
+  for (int v = 0; v < (int) to.size(); ++v) to[v] = v;
+  auto constant = [&](int v, int & k) {
+    if (f.values[v].op != IR_CONST) return false;
+    k = f.values[v].imm;
+    return true;
+  };
+  bool changed = false;
+  for (int l = 0; l < (int) f.loops.size(); ++l) {
+    int preheader = f.loops[l].first, header = f.loops[l].second;
+    vector<int> & preds = f.blocks[header].preds;
+    if (preds.size() != 2 || (preds[0] != preheader && preds[1] != preheader)) continue;
+    int back = preds[0] == preheader ? 1 : 0;
+    naturalLoop(f, preheader, header, l, inLoop);
+    auto inside = [&](int v) { return inLoop[f.values[v].block] == l; };
+    vector<int> phis = f.blocks[header].phis;
+    for (int phi: phis) {
+      int init = f.values[phi].args[1 - back], next = f.values[phi].args[back], step;
+      IRInstr n = f.values[next];
+      if (n.op == IR_ADD && n.args[0] == phi && constant(n.args[1], step)) {
+      } else if (n.op == IR_ADD && n.args[1] == phi && constant(n.args[0], step)) {
+      } else if (n.op == IR_SUB && n.args[0] == phi && constant(n.args[1], step)) {
+        step = -(unsigned) step;
+      } else {
+        continue;
+      }
+      for (int u: users[phi]) {
+        IRInstr m = f.values[u];
+        int k;
+        if (!f.alive(u) || m.op != IR_MUL || !inside(u) || m.args[0] == m.args[1]) continue;
+        if (!constant(m.args[m.args[0] == phi], k)) continue;
+        vector<int> sums;
+        for (int s: users[u]) {
+          IRInstr & sum = f.values[s];
+          if (f.alive(s) && sum.op == IR_ADD && inside(s) && sum.args[0] != sum.args[1] &&
+              !inside(sum.args[sum.args[0] == u])) {
+            sums.push_back(s);
+          } else {
+            sums.assign(1, u);
+            break;
+          }
+        }
+        for (int t: sums) {
+          // t is base + k * phi throughout the loop, base 0 when t is the multiple
+          vector<int> & entry = f.blocks[preheader].code;
+          IRType type = f.values[t].type;
+          int product;
+          vector<int> made;
+          if (f.values[init].op == IR_CONST) {
+            product = newInstr(f, IR_CONST, IR_INT, {}, (unsigned) f.values[init].imm * k, preheader);
+          } else {
+            made.push_back(newInstr(f, IR_CONST, IR_INT, {}, k, preheader));
+            product = newInstr(f, IR_MUL, IR_INT, {init, made.back()}, 0, preheader);
+          }
+          made.push_back(product);
+          int start = product;
+          if (t != u) {
+            int base = f.values[t].args[f.values[t].args[0] == u];
+            start = newInstr(f, IR_ADD, type, {base, product}, 0, preheader);
+            made.push_back(start);
+          }
+          int stride = newInstr(f, IR_CONST, IR_INT, {}, (unsigned) k * step, preheader);
+          made.push_back(stride);
+          entry.insert(entry.end() - 1, made.begin(), made.end());
+          int psi = newInstr(f, IR_PHI, type, {start, start}, 0, header);
+          int stepped = newInstr(f, IR_ADD, type, {psi, stride}, 0, f.values[next].block);
+          f.values[psi].args[back] = stepped;
+          f.blocks[header].phis.push_back(psi);
+          vector<int> & code = f.blocks[f.values[next].block].code;
+          code.insert(find(code.begin(), code.end(), next) + 1, stepped);
+          to[t] = psi;
+          f.remove(t);
+          ++(t == u ? strengthStats.inductions : strengthStats.pointers);
+          changed = true;
+        }
       }
-      if (stmt->children[0]->LH == "IF") { // IF
-        string End = "endif" + rand(); 
-        statements(stmt->getChild("statements",1), varTable, procTable);
-        Beq(0,0,End);
-        Label(jumpTo);
-        statements(stmt->getChild("statements",2), varTable, procTable);
-        Label(End);
-        
-      } else { // WHILE
-        statements(stmt->getChild("statements",1), varTable, procTable);
-        Beq(0,0,whileLabel);
-        Label(jumpTo);
+    }
+  }
+  if (!changed) return false;
+  while (to.size() < f.values.size()) to.push_back(to.size());
+  for (auto & i: f.values) {
+    if (i.block < 0) continue;
+    for (int & a: i.args) {
+      while (to[a] != a) a = to[a];
+    }
+  }
+  f.compact();
+  return true;
+}
+
+// multiplies by constants that take few adds become adds, and division and
+// remainder by a constant a multiply by its reciprocal (Granlund and
+// Montgomery, with the magic numbers of Hacker's Delight 10-1), since mult
+// and div take many cycles. The subset has no shifts, so a right shift by s
+// is the high word of a multiply by 2^(32-s). The instruction itself becomes
+// the last of its sequence, so its uses stay as they are
+const int MUL_ADDS = 4; // most adds a multiply becomes
+
+int mulAdds(unsigned k) { // for k >= 2: doublings, then an add for each other set bit
+  return 31 - __builtin_clz(k) + __builtin_popcount(k) - 1;
+}
+// M and s with n / d == (high word of M * n, plus n if M < 0) >> s, plus 1 if n < 0
+void magic(unsigned d, int & M, int & s) {
+  const unsigned two31 = 0x80000000u;
+  unsigned anc = two31 - 1 - two31 % d;
+  unsigned q1 = two31 / anc, r1 = two31 - q1 * anc, q2 = two31 / d, r2 = two31 - q2 * d, delta;
+  int p = 31;
+  do {
+    ++p;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      ++q1;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= d) {
+      ++q2;
+      r2 -= d;
+    }
+    delta = d - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  M = q2 + 1;
+  s = p - 32;
+}
+bool reduceStrength(IRFunction & f) {
+  bool changed = false;
+  for (int b = 0; b < (int) f.blocks.size(); ++b) {
+    vector<int> old, code;
+    old.swap(f.blocks[b].code);
+    auto emit = [&](IROp op, vector<int> args, int imm = 0) {
+      code.push_back(newInstr(f, op, IR_INT, args, imm, b));
+      return code.back();
+    };
+    auto multiply = [&](int x, int k) {
+      unsigned a = k < 0 ? -(unsigned) k : k;
+      int r = x;
+      for (int bit = 30 - __builtin_clz(a); bit >= 0; --bit) {
+        r = emit(IR_ADD, {r, r});
+        if (a >> bit & 1) r = emit(IR_ADD, {r, x});
       }
+      return k < 0 ? emit(IR_SUB, {emit(IR_CONST, {}, 0), r}) : r;
+    };
+    auto shift = [&](int x, int s) { // arithmetic right shift
+      if (s == 0) return x;
+      if (s == 1) return emit(IR_MULHI, {emit(IR_SUB, {emit(IR_CONST, {}, 0), x}), emit(IR_CONST, {}, (int) 0x80000000u)});
+      return emit(IR_MULHI, {x, emit(IR_CONST, {}, 1 << (32 - s))});
+    };
+    for (int v: old) {
+      IRInstr i = f.values[v];
+      int k, x = -1;
+      if (i.op == IR_MUL || i.op == IR_DIV || i.op == IR_MOD) {
+        int c = i.op == IR_MUL && f.values[i.args[0]].op == IR_CONST ? 0 : 1;
+        x = i.args[1 - c];
+        k = f.values[i.args[c]].imm;
+        if (f.values[i.args[c]].op != IR_CONST) x = -1;
+      }
+      unsigned a = x < 0 ? 0 : k < 0 ? -(unsigned) k : k;
+      int last = -1;
+      if (i.op == IR_MUL && a >= 2 && mulAdds(a) + (k < 0) <= MUL_ADDS) {
+        last = multiply(x, k);
+        ++strengthStats.mults;
+      } else if ((i.op == IR_DIV || i.op == IR_MOD) && a >= 2 && a < 0x80000000u) {
+        int q;
+        if ((a & (a - 1)) == 0 && a <= 8) { // (n + (n < 0 ? a - 1 : 0)) >> log a
+          int bias = emit(IR_SLT, {x, emit(IR_CONST, {}, 0)});
+          if (a > 2) bias = multiply(bias, a - 1);
+          q = shift(emit(IR_ADD, {x, bias}), __builtin_ctz(a));
+        } else {
+          int M, s;
+          magic(a, M, s);
+          q = emit(IR_MULHI, {x, emit(IR_CONST, {}, M)});
+          if (M < 0) q = emit(IR_ADD, {q, x});
+          q = emit(IR_ADD, {shift(q, s), emit(IR_SLT, {x, emit(IR_CONST, {}, 0)})});
+        }
+        if (k < 0) q = emit(IR_SUB, {emit(IR_CONST, {}, 0), q});
+        if (i.op == IR_MOD) {
+          int p = mulAdds(a) + (k < 0) <= MUL_ADDS ? multiply(q, k) : emit(IR_MUL, {q, emit(IR_CONST, {}, k)});
+          emit(IR_SUB, {x, p});
+        }
+        last = code.back();
+        ++strengthStats.divs;
+      }
+      if (last < 0) {
+        code.push_back(v);
+        continue;
+      }
+      // v takes the place of the sequence's last instruction
+      IRInstr & end = f.values[last];
+      f.values[v].op = end.op;
+      f.values[v].args = end.args;
+      f.values[v].imm = end.imm;
+      f.remove(last);
+      code.back() = v;
+      changed = true;
     }
+    f.blocks[b].code = code;
   }
-} 
-void procCode (Tree* procTree, ProcedureTable& procTable) {  // procedure -> INT ID LPARENS params
-  map<string,int> offsetTable ;
-  string procID = procTree->getChild("ID",1)->RH[0] ;
-  int args = procTable.Get(procID).signature.size();
-  // params
-  Tree *params = procTree->getChild("params",1) ;
-  if (!(params->children).empty()) {
-    params = params->getChild("paramlist",1) ;
-    int i = args;
-    args *= 4; 
-    while (i > 0) {
-      offsetTable[params->getChild("dcl",1)->getChild("ID",1)->RH[0]] = args;
-      args -= 4;
-      if ((params->children).size() > 1) {
-        params = params->getChild("paramlist",1);
-      } else {
-        break;
+  return changed;
+}
+
+// removes stores nothing reads: to a variable whose address is only ever
+// stored through, and, scanning each block backwards, to a word written again
+// before memory is read, or to the frame before the procedure returns
+struct DSEStats {
+  long stores = 0;
+};
+DSEStats dseStats;
+bool deadStores(IRFunction & f) {
+  set<int> slots, read; // variables with a word, and those it may be read from
+  for (int v = 0; v < (int) f.values.size(); ++v) {
+    if (!f.alive(v)) continue;
+    IRInstr & i = f.values[v];
+    if (i.op == IR_ADDR) slots.insert(i.imm);
+    for (int a = 0; a < (int) i.args.size(); ++a) {
+      IRInstr & arg = f.values[i.args[a]];
+      if (arg.op == IR_ADDR && !(i.op == IR_STORE && a == 0)) read.insert(arg.imm);
+    }
+  }
+  bool changed = false;
+  for (auto & b: f.blocks) {
+    set<pair<int, int>> written; // (pointer, offset) stored to later on
+    set<int> overwritten;        // variables stored to later on
+    for (int k = b.code.size() - 1; k >= 0; --k) {
+      int v = b.code[k];
+      IRInstr & i = f.values[v];
+      bool addr = (i.op == IR_STORE || i.op == IR_LOAD) && f.values[i.args[0]].op == IR_ADDR && i.imm == 0;
+      int slot = addr ? f.values[i.args[0]].imm : 0;
+      if (i.op == IR_RET) {
+        overwritten = slots;
+      } else if (i.op == IR_STORE) {
+        if (addr ? !read.count(slot) || overwritten.count(slot) : written.count({i.args[0], i.imm})) {
+          f.remove(v);
+          ++dseStats.stores;
+          changed = true;
+        } else if (addr) {
+          overwritten.insert(slot);
+        } else {
+          written.insert({i.args[0], i.imm});
+        }
+      } else if (i.op == IR_LOAD) {
+        // a store through a pointer may have written the variable
+        written.clear();
+        if (addr) {
+          overwritten.erase(slot);
+        } else {
+          overwritten.clear();
+        }
+      } else if (i.op == IR_CALL || i.op == IR_NEW || i.op == IR_DELETE) {
+        written.clear();
+        overwritten.clear();
       }
     }
   }
-  Label("P" + (procTree->getChild("ID",1)->RH[0])); // initialize procedure
-  Sub(29,30,0); // initialize stack pointer
-  int offset = 0;
-  // code for dcls
-  cout << "Here" << endl ;
-  declarations(procTree->getChild("dcls",1), offsetTable, offset);
-  cout << "Here" << endl ;
-  // code for statements
-  statements(procTree->getChild("statements", 1), offsetTable, procTable) ;
-  // code for expr
-  aCode(procTree->getChild("expr", 1), offsetTable) ;
-  Flush(offset);
-  Jr(31);
+  if (changed) f.compact();
+  return changed;
 }
-// generate entire code
 
-void wain(Tree* wainTree, ProcedureTable & procTable) { // main -> INT WAIN ...
-  map<string, int> offsetTable;
-  string name;
-  int offset = 0;
-  Label("main");
-  if (wainTree->getChild("dcl",1)->type == "int") {
-    Add(2,0,0); // Set $2 to 0
+struct IRPass {
+  const char * name;
+  bool (*run)(IRFunction & f); // true if it changed anything
+  double time;                 // seconds, over all procedures
+  long changed;                // procedures it changed
+};
+IRPass irPasses[] = {
+  {"phis", removeTrivialPhis, 0, 0},
+  {"gvn", valueNumbering, 0, 0},
+  {"licm", hoistInvariants, 0, 0},
+  {"ivs", reduceInductions, 0, 0},
+  {"strength", reduceStrength, 0, 0},
+  {"dse", deadStores, 0, 0},
+  {"dce", deadCode, 0, 0},
+};
+
+// runs a pipeline of passes over each procedure, timing them and, when asked,
+// verifying the IR after lowering and after every pass
+struct PassManager {
+  vector<IRPass*> pipeline;
+  bool verify = false;
+  double verifyTime = 0;
+
+  void parse(const string & list) { // comma separated pass names
+    pipeline.clear();
+    stringstream in(list);
+    string name;
+    while (getline(in, name, ',')) {
+      if (name.empty()) continue;
+      IRPass * found = nullptr;
+      for (auto & p: irPasses) {
+        if (name == p.name) found = &p;
+      }
+      if (!found) throw runtime_error("ERROR: unknown pass " + name);
+      pipeline.push_back(found);
+    }
   }
-  // 2 params of wain
-  push(1) ; // push $1 to stack
-  name = (wainTree->getChild("dcl",1))->getChild("ID",1)->RH[0];
-  offsetTable[name] = 8 ;
-  push(2) ; // push $2 to stack
-  name = (wainTree->getChild("dcl",1))->getChild("ID",1)->RH[0];
-  offsetTable[name] = 4 ;
-  Sub(29,30,0); // set $29 to first variable on stack
-  // code for declarations
-  declarations(wainTree->getChild("dcls", 1), offsetTable, offset);
-  // code for statements
-  statements(wainTree->getChild("statements", 1), offsetTable, procTable) ;
-  // code for expr
-  aCode(wainTree->getChild("expr", 1), offsetTable) ;
-  Flush(offset);
-  Jr(31);
+  void check(IRFunction & f, ProcedureTable & procTable, const string & after) {
+    if (!verify) return;
+    auto start = chrono::steady_clock::now();
+    verifyIR(f, procTable, after);
+    verifyTime += secondsSince(start);
+  }
+  void run(IRFunction & f, ProcedureTable & procTable) {
+    check(f, procTable, "lowering");
+    for (IRPass * p: pipeline) {
+      auto start = chrono::steady_clock::now();
+      if (p->run(f)) ++p->changed;
+      p->time += secondsSince(start);
+      check(f, procTable, p->name);
+    }
+  }
+};
+PassManager passManager;
+
+struct IRStats {
+  long procs = 0, values = 0, phis = 0, blocks = 0;
+  long spills = 0, moves = 0;
+  double lower = 0, select = 0;
+} irStats;
+
+// where selection keeps a value
+struct Loc {
+  enum Kind : unsigned char { NONE, REG, MEM, WORD, CONST, FRAME } kind = NONE;
+  int n = 0; // register, offset from $29, frame word, constant or variable slot
+};
+bool sameLoc(Loc a, Loc b) {
+  return a.kind == b.kind && a.n == b.n;
 }
 
-void codeGen(Tree* procTree, ProcedureTable & procTable) {
+// selects MIPS for one procedure. Values get registers by linear scan over
+// the laid out instructions (Poletto and Sarkar), with live ranges kept per
+// block so a value can take a register in the holes of another's; a phi takes
+// the register of its arguments where it can, so most copies out of SSA
+// vanish. Values live across a procedure call only get callee-saved
+// registers, since calls do not save temporaries here. $3 and $5 are scratch
+struct Selector {
+  IRFunction & f;
+  bool isWain;
+  vector<int> layout;
+  vector<int> at;                         // position of each instruction, phis at their block's start
+  vector<int> first, last;                // positions each block spans
+  vector<vector<pair<int, int>>> ranges;  // per value, the positions it is live over, inclusive
+  vector<int> calls;                      // positions of procedure calls
+  vector<Loc> loc;
+  vector<int> saved;                      // callee-saved registers used, pushed in this order
+  map<int, int> localWord;                // frame word of each local whose address is taken
+  int words = 0;                          // frame words, for those locals and then spills
+  bool leaf = true;                       // calls nothing, so $30 stays put after the prologue
+  int links = 0;                          // words below $29 before the saved registers
+  int fp = 29, bias = 0;                  // the frame is addressed from $fp, bias above $29
+  vector<int> target, label;              // per block: where a branch to it goes, its label
+  int params;                             // for argReg, none in wain
+
+  Selector(IRFunction & f) : f{f}, isWain{f.name == "wain"}, params{isWain ? 0 : (int) f.proc->signature.size()} {}
+
+  // loads and stores take a constant offset straight from the address
+  void foldAddresses() {
+    for (auto & i: f.values) {
+      if (i.block < 0 || (i.op != IR_LOAD && i.op != IR_STORE)) continue;
+      while (true) {
+        IRInstr & a = f.values[i.args[0]];
+        if (a.op != IR_ADD && a.op != IR_SUB) break;
+        int base = a.args[0], k = a.args[1];
+        if (a.op == IR_ADD && f.values[base].op == IR_CONST) swap(base, k);
+        if (f.values[k].op != IR_CONST) break;
+        long imm = i.imm + (a.op == IR_SUB ? -1L : 1L) * f.values[k].imm;
+        if (imm < -32768 || imm > 32767) break;
+        i.args[0] = base;
+        i.imm = imm;
+      }
+    }
+    deadCode(f);
+  }
+  // copies for phis go at the end of a predecessor, so an edge from a block
+  // with two successors to one with two predecessors gets a block of its own
+  void splitEdges() {
+    int n = f.blocks.size();
+    for (int b = 0; b < n; ++b) {
+      if (f.blocks[b].succs.size() < 2) continue;
+      for (int i = 0; i < (int) f.blocks[b].succs.size(); ++i) {
+        int s = f.blocks[b].succs[i];
+        if (f.blocks[s].preds.size() < 2) continue;
+        int m = f.blocks.size();
+        f.blocks.push_back(IRBlock());
+        f.values.push_back(IRInstr{IR_JMP, IR_VOID, m, 0, {}, ""});
+        f.blocks[m].code.push_back(f.values.size() - 1);
+        f.blocks[m].preds.push_back(b);
+        f.blocks[m].succs.push_back(s);
+        f.blocks[b].succs[i] = m;
+        vector<int> & preds = f.blocks[s].preds;
+        *find(preds.begin(), preds.end(), b) = m;
+      }
+    }
+  }
+  void number() {
+    layout = f.rpo();
+    at.assign(f.values.size(), -1);
+    first.assign(f.blocks.size(), 0);
+    last.assign(f.blocks.size(), 0);
+    int pos = 0;
+    for (int b: layout) {
+      first[b] = pos;
+      for (int p: f.blocks[b].phis) at[p] = pos;
+      for (int v: f.blocks[b].code) {
+        pos += 2;
+        at[v] = pos;
+        if (f.values[v].op == IR_CALL) calls.push_back(pos);
+      }
+      last[b] = pos + 1;
+      pos += 2;
+    }
+  }
+  // an instruction at position q reads its operands at q and writes its value
+  // at q + 1; copies for phis are read and written the same way at the jump
+  // that ends the predecessor
+  void liveRanges() {
+    int nv = f.values.size(), nb = f.blocks.size();
+    vector<vector<pair<int, int>>> uses(nv); // (block, position)
+    for (int b: layout) {
+      IRBlock & block = f.blocks[b];
+      for (int p: block.phis) {
+        for (int k = 0; k < (int) block.preds.size(); ++k) {
+          int pred = block.preds[k];
+          uses[f.values[p].args[k]].push_back({pred, at[f.blocks[pred].code.back()]});
+        }
+      }
+      for (int v: block.code) {
+        for (int a: f.values[v].args) uses[a].push_back({b, at[v]});
+      }
+    }
+    ranges.assign(nv, vector<pair<int, int>>());
+    vector<int> in(nb, -1), out(nb, -1), lastUse(nb, -1), stamp(nb, -1), touched, work;
+    for (int v = 0; v < nv; ++v) {
+      if (uses[v].empty()) continue;
+      int d = f.values[v].block;
+      touched.clear();
+      auto touch = [&](int b) {
+        if (stamp[b] == v) return;
+        stamp[b] = v;
+        lastUse[b] = -1;
+        touched.push_back(b);
+      };
+      auto liveIn = [&](int b) {
+        if (b == d || in[b] == v) return;
+        in[b] = v;
+        work.push_back(b);
+      };
+      touch(d);
+      for (auto & u: uses[v]) {
+        touch(u.first);
+        lastUse[u.first] = max(lastUse[u.first], u.second);
+        liveIn(u.first);
+      }
+      while (!work.empty()) {
+        int b = work.back();
+        work.pop_back();
+        for (int p: f.blocks[b].preds) {
+          if (out[p] == v) continue;
+          out[p] = v;
+          touch(p);
+          liveIn(p);
+        }
+      }
+      for (int b: touched) {
+        int from = b == d ? at[v] + 1 : first[b];
+        int to = out[b] == v ? last[b] : lastUse[b];
+        ranges[v].push_back({from, max(from, to)});
+      }
+    }
+    // a parameter in a register is copied to its place by the prologue
+    for (int v = 0; v < nv; ++v) {
+      if (f.values[v].op == IR_PARAM && argReg(f.values[v].imm, params) && !ranges[v].empty()) {
+        ranges[v].push_back({first[layout[0]], at[v] + 1});
+      }
+    }
+    // a phi is also written by the copy at the end of each predecessor
+    for (int b: layout) {
+      for (int p: f.blocks[b].phis) {
+        if (ranges[p].empty()) continue;
+        for (int pred: f.blocks[b].preds) ranges[p].push_back({last[pred], last[pred]});
+      }
+    }
+    for (auto & r: ranges) {
+      sort(r.begin(), r.end());
+      int k = 0;
+      for (int i = 1; i < (int) r.size(); ++i) {
+        if (r[i].first <= r[k].second) {
+          r[k].second = max(r[k].second, r[i].second);
+        } else {
+          r[++k] = r[i];
+        }
+      }
+      if (!r.empty()) r.resize(k + 1);
+    }
+  }
+  void allocate() {
+    int nv = f.values.size();
+    loc.assign(nv, Loc());
+    for (int v = 0; v < nv; ++v) {
+      IRInstr & i = f.values[v];
+      if (!f.alive(v)) continue;
+      if (i.op == IR_ADDR) {
+        loc[v] = Loc{Loc::FRAME, i.imm};
+        if ((i.imm < 0 || argReg(i.imm, params)) && !localWord.count(i.imm)) localWord[i.imm] = 0;
+      }
+    }
+    for (auto & w: localWord) w.second = words++;
+    // a phi prefers its arguments' register, and an argument its phi's
+    vector<int> phiOf(nv, -1), order;
+    for (int b: layout) {
+      for (int p: f.blocks[b].phis) {
+        for (int a: f.values[p].args) {
+          if (phiOf[a] < 0) phiOf[a] = p;
+        }
+      }
+    }
+    for (int v = 0; v < nv; ++v) {
+      if (ranges[v].empty() || loc[v].kind != Loc::NONE) continue;
+      IRInstr & i = f.values[v];
+      if (i.op == IR_CONST && (i.imm == 0 || i.imm == 4)) {
+        loc[v] = Loc{Loc::REG, i.imm};
+      } else {
+        order.push_back(v);
+      }
+    }
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return ranges[a][0].first < ranges[b][0].first; });
+    vector<map<int, int>> busy(32); // per register: start -> end of the ranges it holds
+    auto fits = [&](int r, int v) {
+      for (auto & range: ranges[v]) {
+        auto it = busy[r].upper_bound(range.second);
+        if (it != busy[r].begin() && prev(it)->second >= range.first) return false;
+      }
+      return true;
+    };
+    auto crossesCall = [&](int v) {
+      for (auto & range: ranges[v]) {
+        auto it = upper_bound(calls.begin(), calls.end(), range.first);
+        if (it != calls.end() && *it < range.second) return true;
+      }
+      return false;
+    };
+    bitset<32> used;
+    for (int v: order) {
+      bool keep = crossesCall(v);
+      if (keep && !isWain && f.values[v].op == IR_CONST) { // cheaper made again than saved
+        loc[v] = Loc{Loc::CONST, f.values[v].imm};
+        continue;
+      }
+      vector<int> wanted;
+      if (f.values[v].op == IR_PHI) {
+        for (int a: f.values[v].args) {
+          if (loc[a].kind == Loc::REG) wanted.push_back(loc[a].n);
+        }
+      } else if (phiOf[v] >= 0 && loc[phiOf[v]].kind == Loc::REG) {
+        wanted.push_back(loc[phiOf[v]].n);
+      } else if (f.values[v].op == IR_PARAM && !keep && argReg(f.values[v].imm, params)) {
+        wanted.push_back(argReg(f.values[v].imm, params));
+      }
+      if (!keep) {
+        for (int r = FIRST_TEMP; r <= LAST_TEMP; ++r) wanted.push_back(r);
+      }
+      for (int r = FIRST_SAVED; r <= LAST_SAVED; ++r) wanted.push_back(r);
+      int reg = -1;
+      for (int r: wanted) {
+        bool allowed = (r >= FIRST_SAVED && r <= LAST_SAVED) || (!keep && r >= FIRST_TEMP && r <= LAST_TEMP);
+        if (allowed && fits(r, v)) {
+          reg = r;
+          break;
+        }
+      }
+      IRInstr & i = f.values[v];
+      if (reg >= 0) {
+        loc[v] = Loc{Loc::REG, reg};
+        for (auto & range: ranges[v]) busy[reg][range.first] = range.second;
+        used[reg] = true;
+      } else if (i.op == IR_CONST) {
+        loc[v] = Loc{Loc::CONST, i.imm};
+      } else if (i.op == IR_PARAM && !argReg(i.imm, params)) {
+        loc[v] = Loc{Loc::MEM, 4 * i.imm};
+      } else {
+        loc[v] = Loc{Loc::WORD, words++};
+        ++irStats.spills;
+      }
+    }
+    if (!isWain) {
+      for (int r = FIRST_SAVED; r <= LAST_SAVED; ++r) {
+        if (used[r]) saved.push_back(r);
+      }
+    }
+  }
+
+  int offset(Loc l) { // of a location in the frame, from $29
+    int below = links + saved.size();
+    if (l.kind == Loc::WORD) return bias - 4 * (below + l.n + 1);
+    if (l.kind == Loc::FRAME) {
+      return bias + (l.n >= 0 && !localWord.count(l.n) ? 4 * l.n : -4 * (below + localWord[l.n] + 1));
+    }
+    return bias + l.n;
+  }
+  void load(int d, Loc from) {
+    switch (from.kind) {
+      case Loc::REG:
+        if (from.n != d) Add(d, from.n, 0);
+        break;
+      case Loc::CONST:
+        constant(d, from.n);
+        break;
+      case Loc::FRAME:
+        if (offset(from)) {
+          constant(d, offset(from));
+          Add(d, fp, d);
+        } else {
+          Add(d, fp, 0);
+        }
+        break;
+      default:
+        Lw(d, offset(from), fp);
+    }
+  }
+  void move(Loc to, Loc from) {
+    if (to.kind == Loc::REG) {
+      load(to.n, from);
+    } else {
+      int r = 3;
+      if (from.kind == Loc::REG) {
+        r = from.n;
+      } else {
+        load(3, from);
+      }
+      Sw(r, offset(to), fp);
+    }
+  }
+  // a register holding v, loaded into scratch unless it lives in one
+  int use(int v, int scratch) {
+    if (loc[v].kind == Loc::REG) return loc[v].n;
+    load(scratch, loc[v]);
+    return scratch;
+  }
+  int dest(int v) {
+    return loc[v].kind == Loc::REG ? loc[v].n : 3;
+  }
+  void put(int v, int r) {
+    if (loc[v].kind == Loc::WORD || loc[v].kind == Loc::MEM) Sw(r, offset(loc[v]), fp);
+  }
+
+  // the copies an edge out of b makes for its successor's phis
+  vector<pair<Loc, Loc>> copies(int b) {
+    vector<pair<Loc, Loc>> moves;
+    if (f.blocks[b].succs.size() != 1) return moves;
+    IRBlock & s = f.blocks[f.blocks[b].succs[0]];
+    int k = find(s.preds.begin(), s.preds.end(), b) - s.preds.begin();
+    for (int p: s.phis) {
+      Loc to = loc[p], from = loc[f.values[p].args[k]];
+      if (to.kind != Loc::NONE && !sameLoc(to, from)) moves.push_back({to, from});
+    }
+    return moves;
+  }
+  // makes the copies as if all at once, parking a value in $5 to break a cycle
+  void parallelCopy(vector<pair<Loc, Loc>> moves) {
+    irStats.moves += moves.size();
+    while (!moves.empty()) {
+      int i = 0, n = moves.size();
+      for (; i < n; ++i) {
+        bool read = false;
+        for (int j = 0; j < n && !read; ++j) read = j != i && sameLoc(moves[j].second, moves[i].first);
+        if (!read) break;
+      }
+      if (i < n) {
+        move(moves[i].first, moves[i].second);
+        moves.erase(moves.begin() + i);
+        continue;
+      }
+      Loc parked{Loc::REG, 5}, cycle = moves[0].first;
+      move(parked, cycle);
+      for (auto & m: moves) {
+        if (sameLoc(m.second, cycle)) m.second = parked;
+      }
+    }
+  }
+
+  // branches to label when the comparison comes out as when
+  void branch(int cmp, int a, int b, bool ptr, bool when, int label) {
+    switch (cmp) {
+      case CMP_EQ: when ? Beq(a, b, label) : Bne(a, b, label); return;
+      case CMP_NE: when ? Bne(a, b, label) : Beq(a, b, label); return;
+      case CMP_LT: case CMP_GE: ptr ? Sltu(3, a, b) : Slt(3, a, b); break;
+      default: ptr ? Sltu(3, b, a) : Slt(3, b, a); break; // GT, LE
+    }
+    // $3 is set when LT and GT hold, and when LE and GE fail
+    bool set = cmp == CMP_LT || cmp == CMP_GT;
+    set == when ? Bne(3, 0, label) : Beq(3, 0, label);
+  }
+  int labelOf(int b) {
+    if (label[b] < 0) label[b] = emitter.fresh();
+    return label[b];
+  }
+  // how a block leaves, given the block laid out after it: a branch when
+  // the test is taken (or fails), and then a jump
+  struct Exit {
+    int branch = -1, jump = -1;
+    bool onFalse = false;
+  };
+  Exit exitOf(int b, int next) {
+    Exit e;
+    IRInstr & t = f.values[f.blocks[b].code.back()];
+    if (t.op == IR_JMP) {
+      int s = target[f.blocks[b].succs[0]];
+      if (s != next) e.jump = s;
+    } else if (t.op == IR_BR) {
+      int yes = target[f.blocks[b].succs[0]], no = target[f.blocks[b].succs[1]];
+      if (yes == no) {
+        if (yes != next) e.jump = yes;
+      } else if (no == next) {
+        e.branch = yes;
+      } else if (yes == next) {
+        e.branch = no;
+        e.onFalse = true;
+      } else {
+        e.branch = yes;
+        e.jump = no;
+      }
+    }
+    return e;
+  }
+
+  // with calleeLinks the frame is laid out as framePrologue's. A leaf never
+  // pushes, so it addresses all of it from $30
+  void layoutFrame() {
+    if (!calleeLinks) return;
+    for (auto & i: f.values) {
+      if (i.block >= 0 && (i.op == IR_CALL || i.op == IR_NEW || i.op == IR_DELETE || i.op == IR_PRINT)) leaf = false;
+    }
+    links = 1;
+    if (leaf && !isWain) {
+      ++leafProcs;
+      ++framelessProcs;
+      links = -1;
+      fp = 30;
+      bias = frameSize() - 4;
+    }
+  }
+  int frameSize() { // bytes below the caller's $30, or below $1 and $2 in wain
+    return 4 * (links + !isWain + saved.size() + words);
+  }
+  void prologue() {
+    if (isWain) {
+      Label("main");
+      push(1);
+      push(2);
+      Sub(29,30,0);
+      if (links) Sw(31,-4,29);
+    } else {
+      Label("P" + f.name);
+      if (!calleeLinks) {
+        Sub(29,30,0);
+        for (int r: saved) push(r);
+      } else if (fp == 29) {
+        Sw(31,-4,30);
+        Sw(29,-8,30);
+        Sub(29,30,4);
+      }
+    }
+    if (calleeLinks) {
+      Reserve(frameSize());
+      for (int i = 0; i < (int) saved.size(); ++i) Sw(saved[i], bias - 4 * (links + i + 1), fp);
+    } else if (words) {
+      constant(5, 4 * words);
+      Sub(30,30,5);
+    }
+    // parameters that came in registers go where they were allocated
+    vector<pair<Loc, Loc>> moves;
+    for (auto & w: localWord) {
+      if (w.first >= 0) moves.push_back({Loc{Loc::FRAME, w.first}, Loc{Loc::REG, argReg(w.first, params)}});
+    }
+    for (int v = 0; v < (int) f.values.size(); ++v) {
+      IRInstr & i = f.values[v];
+      if (!f.alive(v) || i.op != IR_PARAM || !argReg(i.imm, params) || loc[v].kind == Loc::NONE) continue;
+      Loc from{Loc::REG, argReg(i.imm, params)};
+      if (!sameLoc(loc[v], from)) moves.push_back({loc[v], from});
+    }
+    parallelCopy(moves);
+    if (isWain) {
+      if (f.proc->signature[0] == "int") Add(2,0,0); // no array for init
+      Call("init");
+    }
+  }
+  void epilogue(int v) {
+    int r = use(v, 3);
+    if (r != 3) Add(3, r, 0);
+    for (int i = 0; i < (int) saved.size(); ++i) {
+      Lw(saved[i], bias - 4 * (links + i + 1), fp);
+    }
+    if (fp == 30) {
+      Release(frameSize());
+    } else if (isWain) {
+      if (links) Lw(31,-4,29);
+      Add(30, 29, 0);
+      Add(30, 30, 4); // and the words $1 and $2 were pushed to
+      Add(30, 30, 4);
+    } else if (calleeLinks) {
+      Add(30, 29, 4);
+      Lw(31,-4,30);
+      Lw(29,-8,30);
+    } else {
+      Add(30, 29, 0);
+    }
+    Jr(31);
+  }
+  // runtime procedures take their argument in $1
+  void runtime(string name, int v) {
+    int r = use(v, 1);
+    if (r != 1) Add(1, r, 0);
+    Call(name);
+  }
+  void instr(int v) {
+    IRInstr & i = f.values[v];
+    int d = dest(v);
+    switch (i.op) {
+      case IR_CONST:
+        if (loc[v].kind == Loc::REG && d != 0 && d != 4) constant(d, i.imm);
+        return;
+      case IR_PARAM:
+        if (loc[v].kind == Loc::REG && !argReg(i.imm, params)) Lw(d, 4 * i.imm + bias, fp);
+        return;
+      case IR_ADDR:
+        return;
+      case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD: case IR_MULHI: case IR_SLT: {
+        int a = use(i.args[0], 3), b = use(i.args[1], 5);
+        if (i.op == IR_ADD) {
+          Add(d, a, b);
+        } else if (i.op == IR_SUB) {
+          Sub(d, a, b);
+        } else if (i.op == IR_SLT) {
+          Slt(d, a, b);
+        } else {
+          i.op == IR_DIV || i.op == IR_MOD ? Div(a, b) : Mult(a, b);
+          i.op == IR_MOD || i.op == IR_MULHI ? Mfhi(d) : Mflo(d);
+        }
+        break;
+      }
+      case IR_LOAD:
+        if (loc[i.args[0]].kind == Loc::FRAME) {
+          Lw(d, offset(loc[i.args[0]]) + i.imm, fp);
+        } else {
+          Lw(d, i.imm, use(i.args[0], 3));
+        }
+        break;
+      case IR_STORE: {
+        int r = use(i.args[1], 5);
+        if (loc[i.args[0]].kind == Loc::FRAME) {
+          Sw(r, offset(loc[i.args[0]]) + i.imm, fp);
+        } else {
+          Sw(r, i.imm, use(i.args[0], 3));
+        }
+        return;
+      }
+      case IR_CALL: {
+        if (!calleeLinks) push(29);
+        int inRegs = regArgs ? min((int) i.args.size(), REG_ARGS) : 0;
+        vector<pair<Loc, Loc>> moves;
+        for (int k = 0; k < (int) i.args.size(); ++k) {
+          if (k >= inRegs) {
+            push(use(i.args[k], 3));
+          } else if (!sameLoc(Loc{Loc::REG, ARG_REGS[k]}, loc[i.args[k]])) {
+            moves.push_back({Loc{Loc::REG, ARG_REGS[k]}, loc[i.args[k]]});
+          }
+        }
+        parallelCopy(moves);
+        argsInRegs += inRegs;
+        argsPushed += i.args.size() - inRegs;
+        Call("P" + i.name);
+        if ((int) i.args.size() > inRegs) Flush(4 * (i.args.size() - inRegs));
+        if (!calleeLinks) pop(29);
+        if (d != 3) Add(d, 3, 0);
+        break;
+      }
+      case IR_NEW: {
+        runtime("new", i.args[0]);
+        int done = emitter.fresh();
+        Bne(3,0,done);
+        Lis(3); // NULL when new fails
+        Word(1);
+        Label(done);
+        if (d != 3) Add(d, 3, 0);
+        break;
+      }
+      case IR_DELETE: {
+        int skip = emitter.fresh();
+        int r = use(i.args[0], 1);
+        if (r != 1) Add(1, r, 0);
+        constant(5, 1);
+        Beq(1,5,skip); // NULL is not deleted
+        Call("delete");
+        Label(skip);
+        return;
+      }
+      case IR_PRINT:
+        runtime("print", i.args[0]);
+        return;
+      default:
+        return;
+    }
+    put(v, d);
+  }
+
+  void emit() {
+    int nb = f.blocks.size();
+    vector<vector<pair<Loc, Loc>>> moves(nb);
+    vector<bool> skip(nb, false);
+    for (int b: layout) {
+      moves[b] = copies(b);
+      skip[b] = b != layout[0] && f.blocks[b].code.size() == 1 &&
+                f.values[f.blocks[b].code[0]].op == IR_JMP && moves[b].empty();
+    }
+    // a block that only jumps on is passed straight through
+    target.assign(nb, -1);
+    for (int b = 0; b < nb; ++b) {
+      int t = b;
+      for (int steps = 0; skip[t] && steps < nb; ++steps) t = f.blocks[t].succs[0];
+      target[b] = t;
+    }
+    vector<int> order;
+    for (int b: layout) {
+      if (!skip[b]) order.push_back(b);
+    }
+    label.assign(nb, -1);
+    vector<Exit> exits;
+    for (int k = 0; k < (int) order.size(); ++k) {
+      exits.push_back(exitOf(order[k], k + 1 < (int) order.size() ? order[k + 1] : -1));
+      if (exits[k].branch >= 0) labelOf(exits[k].branch);
+      if (exits[k].jump >= 0) labelOf(exits[k].jump);
+    }
+    for (int k = 0; k < (int) order.size(); ++k) {
+      int b = order[k];
+      IRBlock & block = f.blocks[b];
+      if (k == 0) prologue();
+      if (label[b] >= 0) Label(label[b]);
+      for (int j = 0; j + 1 < (int) block.code.size(); ++j) instr(block.code[j]);
+      IRInstr & t = f.values[block.code.back()];
+      if (t.op == IR_RET) {
+        epilogue(t.args[0]);
+        continue;
+      }
+      if (t.op == IR_JMP) parallelCopy(moves[b]);
+      Exit & e = exits[k];
+      if (e.branch >= 0) {
+        int a = use(t.args[0], 3), c = use(t.args[1], 5);
+        branch(t.imm, a, c, f.values[t.args[0]].type == IR_PTR, !e.onFalse, label[e.branch]);
+      }
+      if (e.jump >= 0) Beq(0, 0, label[e.jump]);
+    }
+  }
+
+  void run() {
+    foldAddresses();
+    splitEdges();
+    number();
+    liveRanges();
+    allocate();
+    layoutFrame();
+    emitter.begin();
+    emit();
+  }
+};
+
+// -O3: each procedure goes through the IR rather than straight from the tree
+void irCodeGen(Tree * procTree, ProcedureTable & procTable, bool printIR) {
+  emitter.begin();
   Import("print");
   Import("new");
   Import("delete");
   Import("init");
   constant(4,4);
-  Call("init");
   Beq(0,0,"main");
   while (true) {
-    if (procTree->children.size() > 1) {
-      procCode(procTree->getChild("procedure",1), procTable) ;
-      procTree = procTree->getChild("procedures", 1) ;
-    } else {
-      wain(procTree->getChild("main",1), procTable);
-      break;
+    bool last = procTree->children.size() == 1;
+    Tree * proc = last ? procTree->getChild("main",1) : procTree->getChild("procedure",1);
+    IRFunction f;
+    f.name = last ? "wain" : proc->getChild("ID",1)->RH[0];
+    f.proc = &procTable.Get(last ? "main" : f.name);
+    auto start = chrono::steady_clock::now();
+    IRBuilder(f).lower(proc);
+    irStats.lower += secondsSince(start);
+    passManager.run(f, procTable);
+    if (printIR) f.print(cerr);
+    ++irStats.procs;
+    irStats.blocks += f.blocks.size();
+    for (auto & b: f.blocks) {
+      irStats.values += b.phis.size() + b.code.size();
+      irStats.phis += b.phis.size();
     }
+    start = chrono::steady_clock::now();
+    procBlock[f.proc->name] = emitter.procs.size();
+    Selector(f).run();
+    irStats.select += secondsSince(start);
+    if (last) break;
+    procTree = procTree->getChild("procedures",1);
+  }
+}
+
+// the optimizations an -O level turns on, each of which -fno-<name> turns
+// off again and -f<name> on. -Os goes through the IR, which makes the
+// smallest code, but leaves out whatever trades size for speed. No -O level
+// turns on the IR: it has no inlining or tail calls yet, so on call heavy
+// code it is slower than -O2, and each level must be at least as fast as
+// the one below (tests/bench.py checks). -O3 is -O2 until then; -fir asks
+const int NO_LEVEL = 4;
+struct Switch {
+  const char * name;
+  int level;    // the lowest -O level it is on at, or NO_LEVEL
+  bool forSize; // on at -Os
+  const char * what;
+  bool on;
+};
+Switch switches[] = {
+  {"order", 1, true, "the operand needing more registers evaluated first", false},
+  {"peephole", 1, true, "peephole patterns over the generated code", false},
+  {"tails", 1, true, "tail calls as loops", false},
+  {"rotate", 1, false, "WHILE loops tested at the bottom", false},
+  {"scale", 1, false, "pointer scaling without mult and div", false},
+  {"strip", 1, true, "unreachable procedures dropped", false},
+  {"unread", 1, true, "variables nothing reads dropped", false},
+  {"links", 1, true, "$31 and $29 kept in the callee's frame", false},
+  {"regargs", 1, true, "first four arguments in registers", false},
+  {"inline", 2, false, "small procedures inlined", false},
+  {"ir", NO_LEVEL, true, "code through the SSA IR and its passes", false},
+};
+Switch & optimization(const string & name) {
+  for (auto & s: switches) {
+    if (name == s.name) return s;
   }
+  throw runtime_error("ERROR: unknown optimization " + name);
 }
 
-int main() {
-      srand((unsigned) time(NULL));
+// reports every type error in the program and frees its tree
+int typeErrors(Diagnostics & diags, deque<Tree*> & treeStack) {
+  diags.report(cerr);
+  for (auto &t: treeStack) {
+    delete t;
+  }
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+      // wlp4gen [-O0..3|-Os] [-f[no-]<pass>] [--print-passes] [--fused] [--binary] [--stats]
+      //         [--cfg-dot FILE] [--ir-passes a,b] [--verify-ir] [--print-ir] < program.wlp4 > program.asm (.mips with --binary)
+      bool fused = false;
+      bool stats = false;
+      int optLevel = 0;
+      bool forSize = false;
+      map<string,bool> chosen; // by -f<name> and -fno-<name>, the last one winning
+      bool printPasses = false;
+      bool binary = false;
+      bool printIR = false;
+      string dotFile;
+      string irPasses;
+      bool passList = false; // irPasses given rather than the level's
+      for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-Os") {
+          optLevel = 1;
+          forSize = true;
+        } else if (arg.compare(0, 2, "-O") == 0) {
+          if (arg.size() != 3 || arg[2] < '0' || arg[2] > '3') {
+            cerr << "ERROR: unknown optimization level " << arg << ", use -O0, -O1, -O2, -O3 or -Os\n";
+            return 1;
+          }
+          optLevel = arg[2] - '0';
+          forSize = false;
+        } else if (arg.compare(0, 5, "-fno-") == 0 && arg.size() > 5) {
+          chosen[arg.substr(5)] = false;
+        } else if (arg.compare(0, 2, "-f") == 0 && arg.size() > 2) {
+          chosen[arg.substr(2)] = true;
+        } else if (arg == "--print-passes") {
+          printPasses = true;
+        } else if (arg == "--binary") {
+          binary = true;
+        } else if (arg == "--fused") {
+          fused = true;
+        } else if (arg == "--stats") {
+          stats = true;
+        } else if (arg == "--cfg-dot" && i + 1 < argc) {
+          dotFile = argv[++i];
+        } else if (arg == "--ir-passes" && i + 1 < argc) {
+          irPasses = argv[++i];
+          passList = true;
+        } else if (arg == "--verify-ir") {
+          passManager.verify = true;
+        } else if (arg == "--print-ir") {
+          printIR = true;
+        } else {
+          cerr << "ERROR: unknown option " << arg << "\n";
+          return 1;
+        }
+      }
       DFA dfa;
       try {
         stringstream s (DFAstring);
@@ -917,6 +4614,68 @@ int main() {
         cerr << "ERROR: " << e.what() << "\n";
         return 1;
       }
+      for (auto & s: switches) s.on = forSize ? s.forSize : optLevel >= s.level;
+      if (!passList) { // induction variables and magic numbers take more instructions
+        irPasses = forSize ? "phis,gvn,licm,gvn,licm,dse,dce" : "phis,gvn,licm,ivs,strength,gvn,licm,dse,dce";
+      }
+      // the IR passes go by the names in the pipeline; one turned on that
+      // the pipeline lacks runs last
+      string pipeline;
+      {
+        stringstream in(irPasses);
+        string name;
+        while (getline(in, name, ',')) {
+          if (chosen.count(name) && !chosen[name]) continue;
+          pipeline += (pipeline.empty() ? "" : ",") + name;
+        }
+      }
+      for (auto & c: chosen) {
+        bool irPass = false;
+        for (auto & p: ::irPasses) irPass = irPass || c.first == p.name;
+        if (irPass) {
+          if (c.second && ("," + pipeline + ",").find("," + c.first + ",") == string::npos) {
+            pipeline += (pipeline.empty() ? "" : ",") + c.first;
+          }
+          continue;
+        }
+        try {
+          optimization(c.first).on = c.second;
+        } catch (runtime_error &e) {
+          cerr << e.what() << "\n";
+          return 1;
+        }
+      }
+      // some only apply to one backend, or need another; asking for one
+      // that can't be had gets a warning
+      auto turnOff = [&](const char * name, const string & why) {
+        Switch & s = optimization(name);
+        if (s.on && chosen.count(name)) cerr << "WARNING: -f" << name << " is off " << why << "\n";
+        s.on = false;
+      };
+      if (fused) {
+        turnOff("ir", "with --fused");
+        turnOff("inline", "with --fused");
+        turnOff("unread", "with --fused");
+      }
+      if (optimization("ir").on) turnOff("inline", "when code goes through the IR");
+      if (!optimization("links").on) turnOff("regargs", "without -flinks");
+      bool useIR = optimization("ir").on;
+      bool peepholes = optimization("peephole").on;
+      tails.enabled = optimization("tails").on;
+      orderByNeed = optimization("order").on;
+      rotateLoops = optimization("rotate").on;
+      addScale = optimization("scale").on;
+      stripper.enabled = optimization("strip").on;
+      dropUnread = optimization("unread").on;
+      calleeLinks = optimization("links").on;
+      regArgs = optimization("regargs").on;
+      if (printPasses) {
+        for (auto & s: switches) {
+          cout << (s.on ? "  on  " : "  off ") << s.name << string(10 - string(s.name).size(), ' ') << s.what << "\n";
+        }
+        if (useIR) cout << "ir passes: " << pipeline << "\n";
+        return 0;
+      }
       
       vector<Rule> cfgRules;
       try {
@@ -955,17 +4714,124 @@ int main() {
       // been tokenized
       deque<Tree*> treeStack; 
       ProcedureTable procs = ProcedureTable() ;
+      Diagnostics diags;
+      bool parsed = false;
+      fusedDiags.first = true;
       try {
         tokensToTrees(program, cfgRules, slr, treeStack) ;
+        parsed = true;
         // cout << treeStack.size();
         // treeStack[0]->print();
         
-        collectProcedures(treeStack[0]->getChild("procedures",1),procs);
-        codeGen(treeStack[0]->getChild("procedures",1), procs);
+        auto start = chrono::steady_clock::now();
+        CallGraph graph;
+        vector<Tree*> procTrees; // in the graph's order
+        if (stripper.enabled || optimization("inline").on) graph.build(treeStack[0]->getChild("procedures",1), &procTrees);
+        if (!fused) {
+          collectProcedures(treeStack[0]->getChild("procedures",1), procs, diags);
+          if (!diags.empty()) return typeErrors(diags, treeStack);
+          folder.fold(treeStack[0]);
+          if (optimization("inline").on) inliner.plan(graph, procTrees);
+        }
+        double checkTime = secondsSince(start);
+        start = chrono::steady_clock::now();
+        // nothing is written until the whole program has been generated,
+        // so a fused mode type error leaves no partial output
+        if (useIR) {
+          passManager.parse(pipeline);
+          irCodeGen(treeStack[0]->getChild("procedures",1), procs, printIR);
+        } else {
+          codeGen(treeStack[0]->getChild("procedures",1), procs, fused);
+        }
+        vector<int> gone;
+        if (inliner.enabled) inliner.prune(emitter, gone);
+        if (stripper.enabled) stripper.unreachable(graph, emitter, gone);
+        emitter.drop(gone);
+        double genTime = secondsSince(start);
+        start = chrono::steady_clock::now();
+        size_t before = emitter.size();
+        if (peepholes) peephole(emitter);
+        double peepTime = secondsSince(start);
+        if (stats || !dotFile.empty()) {
+          ofstream dot;
+          if (!dotFile.empty()) {
+            dot.open(dotFile);
+            if (!dot) throw runtime_error("ERROR: cannot write " + dotFile);
+          }
+          analyseCFGs(emitter, dotFile.empty() ? nullptr : &dot);
+        }
+        start = chrono::steady_clock::now();
+        if (binary) {
+          emitter.writeBinary(cout);
+        } else {
+          emitter.write(cout);
+        }
+        double writeTime = secondsSince(start);
+        if (stats) {
+          cerr << "instructions: " << emitter.size() << " in " << emitter.procs.size() << " blocks\n";
+          cerr << "temporaries: peak " << temps.peak << ", spills " << temps.spills << ", saved around calls " << temps.saves << "\n";
+          cerr << "variables: " << promotedVars << " in registers, " << stackVars << " on the stack, " << unreadVars << " never read\n";
+          cerr << "folded: " << folder.folded << " nodes\n";
+          if (tails.enabled) cerr << "tail calls: " << tails.count << "\n";
+          if (rotateLoops) cerr << "rotated: " << rotated << " loops\n";
+          if (addScale) cerr << "scaled: " << scaled << " pointer operations without mult or div\n";
+          if (calleeLinks) {
+            cerr << "frames: " << leafProcs << " leaf procedures keep no $31, " << framelessProcs << " of them no $29\n";
+          }
+          if (regArgs) {
+            cerr << "arguments: " << argsInRegs << " in registers, " << argsPushed << " pushed\n";
+          }
+          if (stripper.enabled) {
+            cerr << "unreachable: " << stripper.procs << " procedures, " << stripper.bytes << " bytes dropped\n";
+          }
+          if (inliner.enabled) {
+            long calls = 0;
+            for (auto & e: inliner.expanded) calls += e.second;
+            cerr << "inlined: " << calls << " calls to " << inliner.expanded.size() << " of "
+                 << inliner.candidates.size() << " candidates, " << inliner.declined << " declined, "
+                 << inliner.dropped << " instructions of unused bodies dropped\n";
+          }
+          if (useIR) {
+            cerr << "ir: " << irStats.values << " values, " << irStats.phis << " phis, " << irStats.blocks
+                 << " blocks in " << irStats.procs << " procedures; " << irStats.spills << " spilled, "
+                 << irStats.moves << " copies out of SSA\n";
+            cerr << "ir time: lowering " << irStats.lower * 1000 << " ms, selection " << irStats.select * 1000 << " ms";
+            if (passManager.verify) cerr << ", verifying " << passManager.verifyTime * 1000 << " ms";
+            cerr << "\n";
+            cerr << "gvn: " << gvnStats.exprs << " expressions and " << gvnStats.loads << " loads reused\n";
+            cerr << "licm: " << licmStats.hoisted << " instructions and " << licmStats.loads << " loads hoisted out of "
+                 << licmStats.loops << " loops\n";
+            cerr << "strength: " << strengthStats.inductions << " induction variables and " << strengthStats.pointers
+                 << " pointers stepped, " << strengthStats.mults << " multiplies and " << strengthStats.divs << " divisions by constants\n";
+            cerr << "dse: " << dseStats.stores << " stores removed\n";
+            for (IRPass * p: passManager.pipeline) {
+              cerr << "  " << p->name << ": changed " << p->changed << " procedures in " << p->time * 1000 << " ms\n";
+            }
+          }
+          cerr << "check time: " << checkTime * 1000 << " ms\n";
+          cerr << "codegen time: " << genTime * 1000 << " ms\n";
+          if (peepholes) {
+            cerr << "peephole: " << before << " -> " << emitter.size() << " instructions in " << peepTime * 1000 << " ms\n";
+            for (auto & p: patterns) {
+              cerr << "  " << p.name << ": " << p.hits << "\n";
+            }
+          }
+          cerr << "cfg: " << cfgStats.blocks << " blocks, " << cfgStats.edges << " edges, " << cfgStats.defs
+               << " definitions in " << cfgStats.procs << " procedures\n";
+          cerr << "cfg time: build " << cfgStats.build * 1000 << " ms, liveness " << cfgStats.live * 1000
+               << " ms, reaching definitions " << cfgStats.reach * 1000 << " ms, dominators " << cfgStats.dom * 1000 << " ms\n";
+          cerr << "write time: " << writeTime * 1000 << " ms\n";
+        }
         for (auto &t: treeStack) {
           delete t;
         }
       } catch (runtime_error &e) {
+        // fused mode stops at its first error; the separate check finds all of them
+        if (fused && parsed) {
+          ProcedureTable checked;
+          collectProcedures(treeStack[0]->getChild("procedures",1), checked, diags);
+          if (!diags.empty()) return typeErrors(diags, treeStack);
+        }
         cerr << "ERROR: " << e.what() << "\n";
         for (auto &t: treeStack) {
           delete t;
@@ -1033,6 +4899,10 @@ bool DFA::accepting(string state) {
                             "wh","whi","whil",
                             "N","NU","NUL"};
         int length = s.length();
+        int start = 0; // index of the first character of lexeme
+        int scanned = 0;
+        int line = 1;
+        int col = 1;
         for (int i = 0 ; i < length; ++i) {
           // cout << i << " " << s[i] << " " << lexeme << " " << state << "\n" ; 
             if ((nextState(state, s[i]) == "") || (i == length - 1)) {
@@ -1041,8 +4911,19 @@ bool DFA::accepting(string state) {
                 // last token?
                 if ((i == length - 1) && (nextState(state,s[i])!= "")) {
                   state = nextState(state, s[i]);
+                  if (lexeme.empty()) start = i;
                   lexeme += s[i] ;
                 }
+                // advance line/column to the start of the lexeme
+                while (scanned < start) {
+                  if (s[scanned] == '\n') {
+                    ++line;
+                    col = 1;
+                  } else {
+                    ++col;
+                  }
+                  ++scanned;
+                }
 
                 if (accepting(state)) {
                     //cout << "accepting"  << "\n";
@@ -1053,7 +4934,7 @@ bool DFA::accepting(string state) {
                       if (val > 2147483647) {
                         throw runtime_error("ERROR: Integer value out of range!");
                       } else {
-                        program.push_back(token("NUM", lexeme));
+                        program.push_back(token("NUM", lexeme, line, col));
                         // cout << "NUM" << " " << lexeme << "\n" ;
                       }
                     } else if (state == "lead") {
@@ -1062,13 +4943,13 @@ bool DFA::accepting(string state) {
                         bool incomplete = true;
                         for (auto i: subcom) {
                           if (i == lexeme) {
-                            program.push_back(token("ID", lexeme));
+                            program.push_back(token("ID", lexeme, line, col));
                             // cout << "ID" << " " << lexeme << "\n" ;
                             incomplete = !incomplete;
                             break;
                           }
                         } if (incomplete) {
-                          program.push_back(token(state, lexeme));
+                          program.push_back(token(state, lexeme, line, col));
                           // cout << state << " " << lexeme << "\n";
                         }
                     } 
@@ -1080,6 +4961,7 @@ bool DFA::accepting(string state) {
                 }
             } else {
               state = nextState(state, s[i]) ;
+              if (lexeme.empty()) start = i;
               lexeme += s[i] ;
               // cout << "newState: " << state << ", newLexeme: " << lexeme << "\n";
             }
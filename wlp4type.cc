@@ -5,9 +5,16 @@
 #include <vector>
 #include <cctype>
 #include <map>
+#include <algorithm>
 #include <bitset>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
 #include "dfa.h"
 #include "wlp4data.h"
+#include "callgraph.h"
 
 using namespace std;
 
@@ -19,7 +26,11 @@ struct token {
     string type;
     string lexeme;
 
+    int line = 0;
+    int col = 0;
+
     token(string type, string lexeme) : type{type}, lexeme{lexeme} {}
+    token(string type, string lexeme, int line, int col) : type{type}, lexeme{lexeme}, line{line}, col{col} {}
 };
 
 struct DFA {
@@ -40,6 +51,8 @@ struct Tree{
     vector<string> RH;
     string type;
     vector<Tree*> children;
+    int line = 0; // source position, set on token leaves only
+    int col = 0;
     Tree(string data) {
         istringstream iss{data};
         string s;
@@ -71,6 +84,20 @@ struct Tree{
              
     }
 
+    // position of the first token under this node; false if it covers none
+    bool position(int &l, int &c) {
+        if (children.empty()) {
+            if (line == 0) return false;
+            l = line;
+            c = col;
+            return true;
+        }
+        for (auto &child : children) {
+            if (child->position(l, c)) return true;
+        }
+        return false;
+    }
+
     Tree* getChild(string type, int i) {
         for (int j = 0; j < RH.size(); ++j) {
             if (RH[j] == type) {
@@ -156,6 +183,8 @@ void shift(deque<token> &input, deque<Tree*> &treeStack, deque<int> &stateStack,
   token symbol = input.front() ;
   input.pop_front() ;
   Tree* newNode = new Tree(symbol.type + " " + symbol.lexeme) ;
+  newNode->line = symbol.line;
+  newNode->col = symbol.col;
   treeStack.push_back(newNode) ;
   // cout << "SHIFT Node:" << symbol.type + " " + symbol.lexeme << "\n" ;
   if (transition.find(make_pair(stateStack.back(), symbol.type)) == transition.end()) {
@@ -197,6 +226,36 @@ void tokensToTrees(deque<token> & program, vector<Rule> & cfgRule, SLR & slr, de
   
 }
 
+// type assigned to a node after a type error; anything built from a poisoned
+// operand is poisoned too, without reporting again
+const string POISON = "?";
+
+struct Diagnostic {
+    int line;
+    int col;
+    string message;
+};
+
+// collects semantic errors so one run reports all of them
+struct Diagnostics {
+    vector<Diagnostic> errors;
+    void error(Tree *at, string message) {
+        int line = 0, col = 0;
+        if (at) at->position(line, col);
+        errors.push_back(Diagnostic{line, col, message});
+    }
+    bool empty() { return errors.empty(); }
+    void report(ostream &out) {
+        stable_sort(errors.begin(), errors.end(), [](const Diagnostic &a, const Diagnostic &b) {
+            return a.line < b.line || (a.line == b.line && a.col < b.col);
+        });
+        for (auto &e : errors) {
+            out << "ERROR: " << e.line << ":" << e.col << ": " << e.message << "\n";
+        }
+        out << errors.size() << (errors.size() == 1 ? " error\n" : " errors\n");
+    }
+};
+
 struct Variable {
     string name;
     string type;
@@ -212,19 +271,16 @@ struct Variable {
 
 struct VariableTable {
     map<string,Variable> varTable;
-    void Add(Variable &var) {
+    bool Add(Variable &var) {
         if (varTable.find(var.name) == varTable.end()) {
             varTable[var.name] = var ;
-        } else {
-            throw runtime_error("ERROR: Duplicate variable definition!");
+            return true;
         }
+        return false;
     }
-    Variable & Get(string var) {
-        if (varTable.find(var) != varTable.end()) {
-            return varTable[var];
-        } else {
-            throw runtime_error("ERROR: Undeclared Variable!");
-        }
+    Variable * Find(string var) {
+        auto it = varTable.find(var);
+        return it == varTable.end() ? nullptr : &it->second;
     }
 };
 
@@ -233,21 +289,16 @@ struct Procedure {
     vector<string> signature;
     VariableTable symTable; 
     Procedure() {}
-    Procedure(Tree * proc) {
+    Procedure(Tree * proc, Diagnostics & diags) {
         if (proc->LH == "main") { // main
             //name
             name = "main" ;
             // param # 1
-            Variable dcl = Variable(proc->getChild("dcl", 1));
-            symTable.Add(dcl);
+            Variable dcl = declare(proc->getChild("dcl", 1), diags);
             signature.push_back(dcl.type);
             // param # 2
-            dcl = Variable(proc->getChild("dcl", 2));
-            if (dcl.type == "int") {
-                symTable.Add(dcl);
-            } else {
-                throw runtime_error("ERROR: main param #2 not int!");
-            }
+            dcl = declare(proc->getChild("dcl", 2), diags);
+            if (dcl.type != "int") diags.error(proc->getChild("dcl", 2), "main param #2 not int") ;
             signature.push_back("int");
         } else { // procedure
             //name
@@ -257,8 +308,7 @@ struct Procedure {
             if (!(params->children).empty()) {
                 params = params->getChild("paramlist",1) ; 
                 while (true) {
-                    Variable param = Variable(params->getChild("dcl",1));
-                    symTable.Add(param);
+                    Variable param = declare(params->getChild("dcl",1), diags);
                     signature.push_back(param.type);
                     if ((params->children).size() > 1) {
                         params = params->getChild("paramlist",1);
@@ -273,39 +323,40 @@ struct Procedure {
             if ((dcls->children).empty()) {
                 break;
             } else {
-                Variable var = Variable(dcls->getChild("dcl",1)) ;
+                Variable var = declare(dcls->getChild("dcl",1), diags) ;
                 string value = dcls->RH[3];
-                if (var.type == "int" && value == "NULL")  throw runtime_error("ERROR: wrong type for declaration") ;
-                if (var.type == "int*" && value == "NUM")  throw runtime_error("ERROR: wrong type for declaration") ;
-                symTable.Add(var);
+                if (var.type == "int" && value == "NULL")  diags.error(dcls->getChild("dcl",1), "wrong type for declaration of " + var.name) ;
+                if (var.type == "int*" && value == "NUM")  diags.error(dcls->getChild("dcl",1), "wrong type for declaration of " + var.name) ;
                 dcls = dcls->getChild("dcls",1);
             }
         }
     }
+    Variable declare(Tree * dcl, Diagnostics & diags) {
+        Variable var = Variable(dcl);
+        if (!symTable.Add(var)) diags.error(dcl, "duplicate variable definition " + var.name);
+        return var;
+    }
 };
 
 struct ProcedureTable {
     map<string, Procedure> procTable;
-    void Add(Procedure &proc) {
+    bool Add(Procedure &proc) {
         if (procTable.find(proc.name) == procTable.end()) {
             procTable[proc.name] = proc ;
-        } else {
-            throw runtime_error("ERROR: Duplicate procedure definition!");
+            return true;
         }
+        return false;
     }
-    Procedure &Get(string proc) {
-        if (procTable.find(proc) != procTable.end()) {
-            return procTable[proc];
-        } else {
-            throw runtime_error("ERROR: Undeclared Procedure!");
-        }
+    Procedure * Find(string proc) {
+        auto it = procTable.find(proc);
+        return it == procTable.end() ? nullptr : &it->second;
     }
 };
 
-void checkStatements(Tree* subTree) {
+void checkStatements(Tree* subTree, Diagnostics & diags) {
     if (!(subTree->RH).empty()) {
         // statements
-        checkStatements(subTree->getChild("statements",1)) ;
+        checkStatements(subTree->getChild("statements",1), diags) ;
         // statement
         Tree *statement = subTree->getChild("statement",1) ;
         // cout << statement->LH ;
@@ -315,45 +366,80 @@ void checkStatements(Tree* subTree) {
         
         int n = statement->RH.size() ;
         if (n == 4) { // lvalue BECOMES expr SEMI
-            if (statement->getChild("lvalue",1)->type != statement->getChild("expr",1)->type) throw runtime_error("ERROR: lvalue BECOMES expr types are not the same in test!") ;
+            string lhs = statement->getChild("lvalue",1)->type ;
+            string rhs = statement->getChild("expr",1)->type ;
+            if (lhs != rhs && lhs != POISON && rhs != POISON) diags.error(statement, "lvalue BECOMES expr types are not the same") ;
         } else if (n == 5) { 
+            string type = statement->getChild("expr", 1)->type ;
             if (statement->RH[0] == "PRINTLN") { // PRINTLN
-                if (statement->getChild("expr", 1)->type != "int") throw runtime_error("ERROR: PRINTLN expr type not int!") ;
+                if (type != "int" && type != POISON) diags.error(statement, "PRINTLN expr type not int") ;
             } else { // DELETE
-                if (statement->getChild("expr",1)->type != "int*") throw runtime_error("ERROR: DELETE expr type not int*!") ;
+                if (type != "int*" && type != POISON) diags.error(statement, "DELETE expr type not int*") ;
             }
         } else { // WHILE or IF
             // test
             Tree* test = statement->getChild("test", 1) ;
-            if ((test->getChild("expr",1))->type != (test->getChild("expr",2))->type) throw runtime_error("ERROR: expr types are not the same in test!") ;
+            string lhs = test->getChild("expr",1)->type ;
+            string rhs = test->getChild("expr",2)->type ;
+            if (lhs != rhs && lhs != POISON && rhs != POISON) diags.error(test, "expr types are not the same in test") ;
             if (statement->children[0]->LH == "IF") { // IF
-                checkStatements(statement->getChild("statements",1));
-                checkStatements(statement->getChild("statements",2));
+                checkStatements(statement->getChild("statements",1), diags);
+                checkStatements(statement->getChild("statements",2), diags);
             } else { // WHILE
-                checkStatements(statement->getChild("statements",1));
+                checkStatements(statement->getChild("statements",1), diags);
             }
         }
     }
 }
 
-void annoteTypes(Tree* subTree, VariableTable & vars, ProcedureTable & procs) {
+string varType(Tree * id, VariableTable & vars, Diagnostics & diags) {
+    Variable *var = vars.Find(id->RH[0]);
+    if (!var) {
+        diags.error(id, "undeclared variable " + id->RH[0]);
+        return POISON;
+    }
+    return var->type;
+}
+
+// type of a call to id, or POISON after reporting why it is not a valid callee
+string calleeType(Tree * call, VariableTable & vars, ProcedureTable & procs, Diagnostics & diags, Procedure * & callee) {
+    string id = (call->getChild("ID", 1))->RH[0] ;
+    callee = nullptr;
+    if (id == "main") {
+        diags.error(call, "function wain cannot be called recursively");
+        return POISON;
+    }
+    if (vars.Find(id)) {
+        diags.error(call, "variable " + id + " called as procedure");
+        return POISON;
+    }
+    callee = procs.Find(id);
+    if (!callee) {
+        diags.error(call, "undeclared procedure " + id);
+        return POISON;
+    }
+    return "int";
+}
+
+void annoteTypes(Tree* subTree, VariableTable & vars, ProcedureTable & procs, Diagnostics & diags) {
     // cout << subTree->LH ;
     // for (auto &c : subTree->RH) {
     //   cout << " " << c;
     // } cout << endl;
     for (auto &c: subTree->children) {
-      annoteTypes(c, vars, procs) ;
+      annoteTypes(c, vars, procs, diags) ;
     }
     if (subTree->LH == "NUM") {
         subTree->type = "int";
     } else if (subTree->LH == "NULL") {
         subTree->type = "int*";
     } else if (subTree->LH == "factor") {
-        string id;
+        string type;
+        Procedure *callee;
         switch ((subTree->RH).size()) {
             case 1:
                 if (subTree->RH[0] == "ID") { // ID
-                    subTree->type = (vars.Get((subTree->getChild("ID",1)->RH)[0])).type ;
+                    subTree->type = varType(subTree->getChild("ID",1), vars, diags) ;
                     
                 } else { // NUM NULL
                     subTree->type = ((subTree->children)[0])->type ;
@@ -361,77 +447,88 @@ void annoteTypes(Tree* subTree, VariableTable & vars, ProcedureTable & procs) {
                 break;
             case 2:
                 if (subTree->RH[0] == "AMP") { // AMP lvalue
-                    if (subTree->getChild("lvalue", 1)->type == "int") {
+                    type = subTree->getChild("lvalue", 1)->type ;
+                    if (type == "int") {
                         subTree->type = "int*" ;
                     } else {
-                        throw runtime_error("ERROR: factor -> AMP lvalue where lvalue type is not int") ;
+                        if (type != POISON) diags.error(subTree, "factor -> AMP lvalue where lvalue type is not int") ;
+                        subTree->type = POISON ;
                     }
                 } else { // STAR factor
-                    if (subTree->getChild("factor",1)->type == "int*") {
+                    type = subTree->getChild("factor",1)->type ;
+                    if (type == "int*") {
                         subTree->type = "int" ;
                     } else {
-                        throw runtime_error("ERROR: factor -> STAR factor where factor type is not int*") ;
+                        if (type != POISON) diags.error(subTree, "factor -> STAR factor where factor type is not int*") ;
+                        subTree->type = POISON ;
                     }
                 }
                 break;
             case 3:
                 if (subTree->RH[0] == "ID") { // ID LPAREN RPAREN
-                    id = (subTree->getChild("ID", 1))->RH[0] ;
-                    if (id == "main") throw runtime_error("ERROR: function wain cannot be called recursively!") ;
-                    // cout << "id: " << id << endl;
-                    if (vars.varTable.find(id) == vars.varTable.end()) { // check
-                        if (procs.Get(id).signature.size() > 0) throw runtime_error("ERROR: wrong number of variables in empty procedure " + id) ;
-                        subTree->type = "int" ;
-                    } else {
-                        throw runtime_error("ERROR: variable " + id + " called as procedure");
+                    subTree->type = calleeType(subTree, vars, procs, diags, callee) ;
+                    if (callee && callee->signature.size() > 0) {
+                        diags.error(subTree, "wrong number of arguments to procedure " + callee->name) ;
+                        subTree->type = POISON ;
                     }
                 } else { // LPAREN expr RPAREN
                   subTree->type = (subTree->getChild("expr",1))->type;
                 }
                 break;
             case 4: // ID LPAREN arglist RPAREN      
-                id = (subTree->getChild("ID", 1))->RH[0] ;
-                if (id == "main") throw runtime_error("ERROR: function wain cannot be called recursively!") ;
-                if (vars.varTable.find(id) == vars.varTable.end()) { // check
+                subTree->type = calleeType(subTree, vars, procs, diags, callee) ;
+                if (callee) {
                     Tree *args = subTree->getChild("arglist",1) ; 
-                    vector<string> sign = procs.Get(id).signature ;
+                    vector<string> &sign = callee->signature ;
                     int n = sign.size() ;
-                    if (n == 0) throw runtime_error("ERROR: too many parameters");
-                    for (int i = 0; i < n ; ++i) {
-                        if (sign[i] != (args->getChild("expr",1))->type) throw runtime_error("ERROR: arglist does not match procedure " + id + " signature") ; 
-                        if (i != n - 1) {
-                            if ((args->children).size() > 1) {
-                                args = args->getChild("arglist",1) ;     
-                            } else {
-                                throw runtime_error("ERROR: not enough arguments");
-                            }
+                    int i = 0;
+                    while (true) {
+                        string argType = (args->getChild("expr",1))->type ;
+                        if (i >= n) {
+                            diags.error(subTree, "too many arguments to procedure " + callee->name);
+                            subTree->type = POISON ;
+                            break;
+                        }
+                        if (sign[i] != argType && argType != POISON) {
+                            diags.error(args, "argument " + to_string(i + 1) + " does not match procedure " + callee->name + " signature") ; 
+                            subTree->type = POISON ;
+                        }
+                        ++i;
+                        if ((args->children).size() > 1) {
+                            args = args->getChild("arglist",1) ;     
                         } else {
-                            if ((args->children).size() > 1) throw runtime_error("ERROR: too many arguments");
+                            if (i < n) {
+                                diags.error(subTree, "not enough arguments to procedure " + callee->name);
+                                subTree->type = POISON ;
+                            }
+                            break;
                         }
                     }   
-                    subTree->type = "int" ;
-                } else {
-                    throw runtime_error("ERROR: variable " + id + " called as procedure");
                 }
                 break;
             case 5:
-                if (subTree->getChild("expr",1)->type == "int") {
+                type = subTree->getChild("expr",1)->type ;
+                if (type == "int") {
                         subTree->type = "int*" ;
                 } else {
-                    throw runtime_error("ERROR: factor -> NEW INT LBRACK expr RBRACK where expr type is not int") ;
+                    if (type != POISON) diags.error(subTree, "factor -> NEW INT LBRACK expr RBRACK where expr type is not int") ;
+                    subTree->type = POISON ;
                 }
                 break;
         }
     } else if (subTree->LH == "lvalue") {
+        string type;
         switch ((subTree->RH).size()) {
             case 1: // ID
-                subTree->type = (vars.Get((subTree->getChild("ID",1)->RH)[0])).type ;
+                subTree->type = varType(subTree->getChild("ID",1), vars, diags) ;
                 break;
             case 2: // STAR factor
-                if (subTree->getChild("factor", 1)->type == "int*") {
+                type = subTree->getChild("factor", 1)->type ;
+                if (type == "int*") {
                     subTree->type = "int" ;
                 } else {
-                    throw runtime_error("ERROR: factor -> AMP lvalue where lvalue type is not int") ;
+                    if (type != POISON) diags.error(subTree, "lvalue -> STAR factor where factor type is not int*") ;
+                    subTree->type = POISON ;
                 }
                 break ;
             case 3: // ( lvalue )
@@ -442,8 +539,14 @@ void annoteTypes(Tree* subTree, VariableTable & vars, ProcedureTable & procs) {
         if ((subTree->RH).size() == 1) {// term -> factor
             subTree->type = (subTree->getChild("factor", 1))->type ;
         } else { // term -> term [] factor
-            if (subTree->getChild("term", 1)->type != "int" || subTree->getChild("factor", 1)->type != "int") throw runtime_error("ERROR: term -> term factor not both type int") ;
-            subTree->type = "int" ;
+            string termType = subTree->getChild("term", 1)->type ;
+            string factorType = subTree->getChild("factor", 1)->type ;
+            if (termType == "int" && factorType == "int") {
+                subTree->type = "int" ;
+            } else {
+                if (termType != POISON && factorType != POISON) diags.error(subTree, "term -> term factor not both type int") ;
+                subTree->type = POISON ;
+            }
         }
     } else if (subTree->LH == "expr") {
         if ((subTree->RH).size() == 1) {
@@ -451,51 +554,309 @@ void annoteTypes(Tree* subTree, VariableTable & vars, ProcedureTable & procs) {
         } else {
             string exprType = subTree->getChild("expr",1)->type ;
             string termType = subTree->getChild("term",1)->type ;
-            if (subTree->children[1]->LH == "PLUS") {
-                if (exprType == "int*" && termType == "int*") throw runtime_error("ERROR: expr -> expr PLUS term both type int*") ;
-                subTree->type = (exprType == "int" && termType == "int") ? "int" : "int*" ;
+            if (exprType == POISON || termType == POISON) {
+                subTree->type = POISON ;
+            } else if (subTree->children[1]->LH == "PLUS") {
+                if (exprType == "int*" && termType == "int*") {
+                    diags.error(subTree, "expr -> expr PLUS term both type int*") ;
+                    subTree->type = POISON ;
+                } else {
+                    subTree->type = (exprType == "int" && termType == "int") ? "int" : "int*" ;
+                }
             } else {
-                if (exprType == "int" && termType == "int*") throw runtime_error("ERROR: expr -> expr PLUS term both type int") ;
-                subTree->type = (exprType == "int*" && termType == "int") ? "int*" : "int" ;
+                if (exprType == "int" && termType == "int*") {
+                    diags.error(subTree, "expr -> expr MINUS term is int - int*") ;
+                    subTree->type = POISON ;
+                } else {
+                    subTree->type = (exprType == "int*" && termType == "int") ? "int*" : "int" ;
+                }
             }
         } 
     }  // cout << "--" << subTree->LH << "-- type:" << subTree->type << endl;
 }
 
-void collectProcedures(Tree *procTree) {
+// per-procedure check cache
+// a procedure is keyed on the hash of its token range plus the signatures of
+// every procedure it calls; a hit restores the annotated types (or replays
+// the cached diagnostics) instead of re-running annoteTypes/checkStatements
+const string CACHE_VERSION = "wlp4type-cache 2";
+
+uint64_t fnv1a(const string &s, uint64_t h = 14695981039346656037ULL, char sep = 0) {
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h ^= (unsigned char) sep;
+    h *= 1099511628211ULL;
+    return h;
+}
+
+uint64_t fnv1a(int v, uint64_t h) {
+    for (int i = 0; i < 4; ++i) {
+        h ^= (unsigned char) (v >> (8 * i));
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+string toHex(uint64_t h) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) h);
+    return buf;
+}
+
+bool isTypedNode(Tree *t) {
+    return t->LH == "NUM" || t->LH == "NULL" || t->LH == "factor" || t->LH == "lvalue" || t->LH == "term" || t->LH == "expr";
+}
+
+// positions are cached relative to the start of the procedure so moving a
+// procedure around the file keeps its entry valid
+struct Origin {
+    int line = 0;
+    int col = 0;
+    Origin(Tree *proc) { proc->position(line, col); }
+    int dline(int l) { return l - line; }
+    int dcol(int l, int c) { return l == line ? c - col : c; }
+    int absLine(int dl) { return line + dl; }
+    int absCol(int dl, int dc) { return dl == 0 ? col + dc : dc; }
+};
+
+// hashes the leaves (tokens) of the procedure and collects callee names
+void hashTokens(Tree *t, Origin &origin, uint64_t &h, vector<string> &callees) {
+    if (t->children.empty()) {
+        if (!t->RH.empty()) {
+            h = fnv1a(t->RH[0], fnv1a(t->LH, h, ' '), '\n');
+            h = fnv1a(origin.dcol(t->line, t->col), fnv1a(origin.dline(t->line), h));
+        }
+        return;
+    }
+    if (t->LH == "factor" && t->RH.size() >= 3 && t->RH[0] == "ID") {
+        callees.push_back(t->children[0]->RH[0]);
+    }
+    for (auto &c : t->children) {
+        hashTokens(c, origin, h, callees);
+    }
+}
+
+void collectTypes(Tree *t, string &types) {
+    if (isTypedNode(t)) {
+        types += (t->type == "int*") ? 'p' : (t->type == "int") ? 'i' : '-';
+    }
+    for (auto &c : t->children) {
+        collectTypes(c, types);
+    }
+}
+
+bool applyTypes(Tree *t, const string &types, size_t &i) {
+    if (isTypedNode(t)) {
+        if (i >= types.size()) return false;
+        char c = types[i++];
+        t->type = (c == 'p') ? "int*" : (c == 'i') ? "int" : POISON;
+    }
+    for (auto &c : t->children) {
+        if (!applyTypes(c, types, i)) return false;
+    }
+    return true;
+}
+
+struct CheckCache {
+    string dir;            // empty = caching disabled
+    int hits = 0;
+    int misses = 0;
+    int procedures = 0;
+    double hashTime = 0;   // seconds
+    double checkTime = 0;
+    double ioTime = 0;
+
+    bool enabled() { return !dir.empty(); }
+    void open(string path) {
+        dir = path;
+        filesystem::create_directories(dir);
+    }
+    string file(string key) { return dir + "/" + key + ".chk"; }
+
+    // returns true on a hit; restores types on a pass, replays errors on a fail
+    bool lookup(string key, Tree *proc, Diagnostics &diags) {
+        ifstream in(file(key));
+        if (!in) return false;
+        string version, status, types;
+        if (!getline(in, version) || version != CACHE_VERSION) return false;
+        if (!getline(in, status)) return false;
+        if (status == "fail") {
+            Origin origin(proc);
+            int n;
+            if (!(in >> n)) return false;
+            vector<Diagnostic> errors;
+            for (int i = 0; i < n; ++i) {
+                int dl, dc;
+                string message;
+                if (!(in >> dl >> dc) || !getline(in, message) || message.empty()) return false;
+                errors.push_back(Diagnostic{origin.absLine(dl), origin.absCol(dl, dc), message.substr(1)});
+            }
+            diags.errors.insert(diags.errors.end(), errors.begin(), errors.end());
+            return true;
+        }
+        if (status != "pass" || !getline(in, types)) return false;
+        size_t i = 0;
+        return applyTypes(proc, types, i) && i == types.size();
+    }
+    void store(string key, Tree *proc, vector<Diagnostic> errors) {
+        string tmp = file(key) + ".tmp";
+        {
+            ofstream out(tmp);
+            if (!out) return;
+            out << CACHE_VERSION << "\n";
+            if (errors.empty()) {
+                string types;
+                collectTypes(proc, types);
+                out << "pass\n" << types << "\n";
+            } else {
+                Origin origin(proc);
+                out << "fail\n" << errors.size() << "\n";
+                for (auto &e : errors) {
+                    out << origin.dline(e.line) << " " << origin.dcol(e.line, e.col) << " " << e.message << "\n";
+                }
+            }
+        }
+        // rename so concurrent checkers never see a half written entry
+        if (rename(tmp.c_str(), file(key).c_str()) != 0) remove(tmp.c_str());
+    }
+    void report(ostream &out) {
+        out << "procedures: " << procedures << "\n";
+        if (enabled()) {
+            out << "cache hits: " << hits << ", misses: " << misses;
+            if (procedures > 0) out << ", hit rate: " << (100.0 * hits / procedures) << "%";
+            out << "\n";
+            out << "hash time: " << hashTime * 1000 << " ms\n";
+            out << "cache io time: " << ioTime * 1000 << " ms\n";
+        }
+        out << "check time: " << checkTime * 1000 << " ms\n";
+    }
+};
+
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// type checks one procedure body against its own symbol table
+void checkProcedure(Tree *proc, VariableTable &vars, ProcedureTable &procs, Diagnostics &diags) {
+    annoteTypes(proc, vars, procs, diags) ;
+    checkStatements(proc->getChild("statements",1), diags);
+    string type = (proc->getChild("expr", 1))->type ;
+    if (type != "int" && type != POISON) diags.error(proc->getChild("expr", 1), "return expr type is not int") ;
+}
+
+void cachedCheck(Tree *proc, VariableTable &vars, ProcedureTable &procs, CheckCache &cache, Diagnostics &diags) {
+    ++cache.procedures;
+    if (!cache.enabled()) {
+        auto start = chrono::steady_clock::now();
+        checkProcedure(proc, vars, procs, diags);
+        cache.checkTime += secondsSince(start);
+        return;
+    }
+    auto start = chrono::steady_clock::now();
+    Origin origin(proc);
+    uint64_t tokenHash = fnv1a(CACHE_VERSION);
+    vector<string> callees;
+    hashTokens(proc, origin, tokenHash, callees);
+    // callers depend only on the signatures of what they call
+    uint64_t depHash = fnv1a("deps");
+    sort(callees.begin(), callees.end());
+    callees.erase(unique(callees.begin(), callees.end()), callees.end());
+    for (auto &id : callees) {
+        string dep = id + ":";
+        Procedure *callee = procs.Find(id);
+        if (!callee) {
+            dep += "?";
+        } else {
+            for (auto &t : callee->signature) dep += t + ",";
+        }
+        depHash = fnv1a(dep, depHash, '\n');
+    }
+    string key = toHex(fnv1a(toHex(depHash), tokenHash));
+    cache.hashTime += secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    bool hit = cache.lookup(key, proc, diags);
+    cache.ioTime += secondsSince(start);
+    if (hit) {
+        ++cache.hits;
+        return;
+    }
+    ++cache.misses;
+    start = chrono::steady_clock::now();
+    size_t before = diags.errors.size();
+    checkProcedure(proc, vars, procs, diags);
+    cache.checkTime += secondsSince(start);
+    start = chrono::steady_clock::now();
+    cache.store(key, proc, vector<Diagnostic>(diags.errors.begin() + before, diags.errors.end()));
+    cache.ioTime += secondsSince(start);
+}
+
+void collectProcedures(Tree *procTree, CheckCache &cache, Diagnostics &diags) {
     ProcedureTable procs = ProcedureTable() ;
     Tree * proc ;
     while (true) {
         if (procTree->children.size() > 1) {
             proc = procTree->getChild("procedure",1) ;
-            Procedure newProc = Procedure(proc);
+            Procedure newProc = Procedure(proc, diags);
             // for (auto it = newProc.symTable.varTable.begin(); it != newProc.symTable.varTable.end(); it++) {
             //   cout << "String: " << it->first << endl;
             //   cout << "Variable: " << (it->second).name << endl;
             //   cout << "Type: " << (it->second).type << endl;
             // }
-            procs.Add(newProc) ;
-            annoteTypes(proc, newProc.symTable, procs) ;
-            checkStatements(proc->getChild("statements",1));
-            if ((proc->getChild("expr", 1))->type != "int") throw runtime_error("ERROR: expr type is not int!") ;
+            if (!procs.Add(newProc)) diags.error(proc->getChild("ID",1), "duplicate procedure definition " + newProc.name) ;
+            cachedCheck(proc, newProc.symTable, procs, cache, diags) ;
             procTree = procTree->getChild("procedures",1) ;
         } else { // main
             proc = procTree->getChild("main",1) ;
             // proc->print();
-            Procedure newProc = Procedure(proc); //
+            Procedure newProc = Procedure(proc, diags); //
             procs.Add(newProc) ;
-            Procedure procedure = procs.Get("main") ;
-            annoteTypes(proc, procedure.symTable, procs) ;
-            //cout << "HMMMM\n";
-            checkStatements(proc->getChild("statements",1));
-            //cout << "HMMMMmmm\n";
-            if ((proc->getChild("expr", 1))->type != "int") throw runtime_error("ERROR: expr type is not int!") ;
+            cachedCheck(proc, newProc.symTable, procs, cache, diags) ;
             break;
         }
     } 
 };
 
-int main() {
+// writes to path, or to stdout for "-"
+bool dumpTo(string path, CallGraph &graph, bool dot) {
+    if (path == "-") {
+        dot ? graph.dumpDot(cout) : graph.dumpJSON(cout);
+        return true;
+    }
+    ofstream out(path);
+    if (!out) return false;
+    dot ? graph.dumpDot(out) : graph.dumpJSON(out);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+      // wlp4type [--cache-dir DIR] [--stats] [--callgraph-dot FILE] [--callgraph-json FILE] < program.wlp4
+      CheckCache cache;
+      bool stats = false;
+      string dotFile, jsonFile;
+      for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--cache-dir" && i + 1 < argc) {
+          try {
+            cache.open(argv[++i]);
+          } catch (exception &e) {
+            cerr << "ERROR: cannot open cache directory " << argv[i] << "\n";
+            return 1;
+          }
+        } else if (arg == "--stats") {
+          stats = true;
+        } else if (arg == "--callgraph-dot" && i + 1 < argc) {
+          dotFile = argv[++i];
+        } else if (arg == "--callgraph-json" && i + 1 < argc) {
+          jsonFile = argv[++i];
+        } else {
+          cerr << "ERROR: unknown option " << arg << "\n";
+          return 1;
+        }
+      }
+      auto start = chrono::steady_clock::now();
       DFA dfa;
       try {
         stringstream s (DFAstring);
@@ -541,21 +902,42 @@ int main() {
       
       // been tokenized
       deque<Tree*> treeStack; 
+      Diagnostics diags;
+      CallGraph graph;
       try {
         tokensToTrees(program, cfgRules, slr, treeStack) ;
         // cout << treeStack.size();
         // treeStack[0]->print();
-        collectProcedures(treeStack[0]->getChild("procedures",1));
+        collectProcedures(treeStack[0]->getChild("procedures",1), cache, diags);
+        if (diags.empty()) graph.build(treeStack[0]->getChild("procedures",1));
         for (auto &t: treeStack) {
           delete t;
         }
       } catch (runtime_error &e) {
         cerr << "ERROR: " << e.what() << "\n";
+        if (stats) cache.report(cerr);
         for (auto &t: treeStack) {
           delete t;
         }
         return 1;
       }
+      if (stats) {
+        cache.report(cerr);
+        if (diags.empty()) graph.report(cerr);
+        cerr << "total time: " << secondsSince(start) * 1000 << " ms\n";
+      }
+      if (!diags.empty()) {
+        diags.report(cerr);
+        return 1;
+      }
+      if (!dotFile.empty() && !dumpTo(dotFile, graph, true)) {
+        cerr << "ERROR: cannot write " << dotFile << "\n";
+        return 1;
+      }
+      if (!jsonFile.empty() && !dumpTo(jsonFile, graph, false)) {
+        cerr << "ERROR: cannot write " << jsonFile << "\n";
+        return 1;
+      }
 
       return 0;
     }
@@ -617,6 +999,10 @@ bool DFA::accepting(string state) {
                             "wh","whi","whil",
                             "N","NU","NUL"};
         int length = s.length();
+        int start = 0; // index of the first character of lexeme
+        int scanned = 0;
+        int line = 1;
+        int col = 1;
         for (int i = 0 ; i < length; ++i) {
           // cout << i << " " << s[i] << " " << lexeme << " " << state << "\n" ; 
             if ((nextState(state, s[i]) == "") || (i == length - 1)) {
@@ -625,8 +1011,19 @@ bool DFA::accepting(string state) {
                 // last token?
                 if ((i == length - 1) && (nextState(state,s[i])!= "")) {
                   state = nextState(state, s[i]);
+                  if (lexeme.empty()) start = i;
                   lexeme += s[i] ;
                 }
+                // advance line/column to the start of the lexeme
+                while (scanned < start) {
+                  if (s[scanned] == '\n') {
+                    ++line;
+                    col = 1;
+                  } else {
+                    ++col;
+                  }
+                  ++scanned;
+                }
 
                 if (accepting(state)) {
                     //cout << "accepting"  << "\n";
@@ -637,7 +1034,7 @@ bool DFA::accepting(string state) {
                       if (val > 2147483647) {
                         throw runtime_error("ERROR: Integer value out of range!");
                       } else {
-                        program.push_back(token("NUM", lexeme));
+                        program.push_back(token("NUM", lexeme, line, col));
                         // cout << "NUM" << " " << lexeme << "\n" ;
                       }
                     } else if (state == "lead") {
@@ -646,13 +1043,13 @@ bool DFA::accepting(string state) {
                         bool incomplete = true;
                         for (auto i: subcom) {
                           if (i == lexeme) {
-                            program.push_back(token("ID", lexeme));
+                            program.push_back(token("ID", lexeme, line, col));
                             // cout << "ID" << " " << lexeme << "\n" ;
                             incomplete = !incomplete;
                             break;
                           }
                         } if (incomplete) {
-                          program.push_back(token(state, lexeme));
+                          program.push_back(token(state, lexeme, line, col));
                           // cout << state << " " << lexeme << "\n";
                         }
                     } 
@@ -664,6 +1061,7 @@ bool DFA::accepting(string state) {
                 }
             } else {
               state = nextState(state, s[i]) ;
+              if (lexeme.empty()) start = i;
               lexeme += s[i] ;
               // cout << "newState: " << state << ", newLexeme: " << lexeme << "\n";
             }